@@ -0,0 +1,80 @@
+// affinitybench: cost of migrating a memory-heavy process.
+//   affinitybench [ncpu [nproc]]
+// Runs nproc children that each sweep their own working set,
+// first free to run anywhere, then each pinned to one of ncpu
+// CPUs.  Run with more children than CPUs (make CPUS=4) so
+// that they share CPUs and get rescheduled.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pstat.h"
+
+#define WSET   (128*1024)  // working set per child
+#define SWEEPS 400
+
+struct pstat ps[NPROC];
+
+void
+child(int cpu)
+{
+  char *p;
+  int i, j, n, sum;
+
+  if(cpu >= 0 && sched_setaffinity(0, 1 << cpu) < 0){
+    printf(2, "affinitybench: cannot pin to cpu %d\n", cpu);
+    exit();
+  }
+  if((p = sbrk(WSET)) == (char*)-1){
+    printf(2, "affinitybench: out of memory\n");
+    exit();
+  }
+  sum = 0;
+  for(i = 0; i < SWEEPS; i++)
+    for(j = 0; j < WSET; j += 64)   // one touch per cache line
+      sum += p[j]++;
+
+  n = getprocs(ps, NPROC);
+  for(i = 0; i < n; i++)
+    if(ps[i].pid == getpid())
+      printf(1, "  pid %d cpu %d: %d switches, %d migrations\n",
+        ps[i].pid, ps[i].cpu, ps[i].nswitch, ps[i].nmigrate);
+  exit();
+}
+
+int
+run(int ncpu, int nproc, int pin)
+{
+  int i;
+  uint t0;
+
+  t0 = usecs();
+  for(i = 0; i < nproc; i++)
+    if(fork() == 0)
+      child(pin ? i % ncpu : -1);
+  for(i = 0; i < nproc; i++)
+    wait();
+  return (usecs() - t0) / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ncpu, nproc, tfree, tpin;
+
+  ncpu = argc > 1 ? atoi(argv[1]) : 4;
+  nproc = argc > 2 ? atoi(argv[2]) : 2*ncpu;
+  if(ncpu < 1 || ncpu > NCPU || nproc < 1){
+    printf(2, "usage: affinitybench [ncpu [nproc]]\n");
+    exit();
+  }
+
+  printf(1, "unpinned:\n");
+  tfree = run(ncpu, nproc, 0);
+  printf(1, "pinned:\n");
+  tpin = run(ncpu, nproc, 1);
+  printf(1, "affinitybench: %d procs on %d cpus: unpinned %d ms, pinned %d ms\n",
+    nproc, ncpu, tfree, tpin);
+  exit();
+}
@@ -0,0 +1,130 @@
+// agebench: age the file system with create/delete churn
+// in several directories, then read every surviving file and
+// report disk head movement (from iostat) and throughput.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "iostat.h"
+
+#define NDIR    4
+#define NFILE   16   // files per directory
+#define ROUNDS  8
+#define MAXBLK  24   // largest file, in blocks
+
+char buf[BSIZE];
+int size[NDIR][NFILE];   // blocks, 0 if no file
+uint seed = 1;
+
+uint
+rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7fff;
+}
+
+void
+name(char *p, int d, int f)
+{
+  strcpy(p, "age/d0/f00");
+  p[5] = '0' + d;
+  p[8] = '0' + f/10;
+  p[9] = '0' + f%10;
+}
+
+void
+mkfile(int d, int f, int n)
+{
+  char path[16];
+  int fd, i;
+
+  name(path, d, f);
+  if((fd = open(path, O_CREATE|O_WRONLY)) < 0){
+    printf(2, "agebench: cannot create %s\n", path);
+    exit();
+  }
+  memset(buf, 'a' + f, sizeof(buf));
+  for(i = 0; i < n; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(2, "agebench: write %s failed\n", path);
+      exit();
+    }
+  }
+  close(fd);
+  size[d][f] = n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char path[16];
+  struct iostat st0, st1;
+  int d, f, r, fd, n, nblk;
+  uint t0, t1;
+
+  mkdir("age");
+  for(d = 0; d < NDIR; d++){
+    strcpy(path, "age/d0");
+    path[5] = '0' + d;
+    mkdir(path);
+  }
+
+  // Churn: the directories take turns, so their files'
+  // blocks would interleave if nothing kept them apart.
+  for(r = 0; r < ROUNDS; r++){
+    for(f = 0; f < NFILE; f++){
+      for(d = 0; d < NDIR; d++){
+        if(size[d][f] && (rnd() & 1)){
+          name(path, d, f);
+          unlink(path);
+          size[d][f] = 0;
+        }
+        if(size[d][f] == 0)
+          mkfile(d, f, 1 + rnd() % MAXBLK);
+      }
+    }
+  }
+  sync();
+
+  // Read each directory's files in order.
+  if(iostat(0, &st0) < 0){
+    printf(2, "agebench: no disk queue\n");
+    exit();
+  }
+  nblk = 0;
+  t0 = usecs();
+  for(d = 0; d < NDIR; d++){
+    for(f = 0; f < NFILE; f++){
+      name(path, d, f);
+      if((fd = open(path, O_RDONLY)) < 0)
+        continue;
+      while((n = read(fd, buf, sizeof(buf))) > 0)
+        nblk++;
+      close(fd);
+    }
+  }
+  t1 = (usecs() - t0) / 1000;
+  iostat(0, &st1);
+
+  printf(1, "agebench: read %d blocks in %d ms", nblk, t1);
+  if(t1 > 0)
+    printf(1, " (%d KB/s)", nblk*BSIZE/1024*1000/t1);
+  printf(1, "\n");
+  n = st1.nreq - st0.nreq;
+  printf(1, "agebench: %d disk commands, seek %d blocks (%d per command)\n",
+    n, st1.seek - st0.seek, n ? (st1.seek - st0.seek)/n : 0);
+
+  for(d = 0; d < NDIR; d++){
+    for(f = 0; f < NFILE; f++){
+      name(path, d, f);
+      unlink(path);
+    }
+    strcpy(path, "age/d0");
+    path[5] = '0' + d;
+    unlink(path);
+  }
+  unlink("age");
+  exit();
+}
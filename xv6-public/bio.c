@@ -4,6 +4,9 @@
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
+// Bufs come from an object cache: the list grows to NBUF bufs,
+// then recycles unused ones, and grows beyond only while all
+// are in use, shrinking back as they are released.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
@@ -28,7 +31,8 @@
 
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct kmem_cache *cache;
+  int nbuf;
 
   // Linked list of all buffers, through prev/next.
   // head.next is most recently used.
@@ -38,21 +42,32 @@ struct {
 void
 binit(void)
 {
-  struct buf *b;
-
   initlock(&bcache.lock, "bcache");
+  bcache.cache = kmem_cache_create("buf", sizeof(struct buf));
 
 //PAGEBREAK!
-  // Create linked list of buffers
+  // Create the empty linked list of buffers
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
+}
+
+// Allocate a buf and put it at the head of the list.
+// Returns 0 if out of memory.  Caller must hold bcache.lock.
+static struct buf*
+bufalloc(void)
+{
+  struct buf *b;
+
+  if((b = kmem_cache_alloc(bcache.cache)) == 0)
+    return 0;
+  memset(b, 0, sizeof(*b));
+  initsleeplock(&b->lock, "buffer");
+  b->next = bcache.head.next;
+  b->prev = &bcache.head;
+  bcache.head.next->prev = b;
+  bcache.head.next = b;
+  bcache.nbuf++;
+  return b;
 }
 
 // Look through buffer cache for block on device dev.
@@ -75,21 +90,35 @@ bget(uint dev, uint blockno)
     }
   }
 
-  // Not cached; recycle an unused buffer.
+  // Not cached; recycle an unused buffer if there are NBUF
+  // already, or else allocate one.
   // Even if refcnt==0, B_DIRTY indicates a buffer is in use
   // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  b = &bcache.head;
+  if(bcache.nbuf >= NBUF){
+    for(b = bcache.head.prev; b != &bcache.head; b = b->prev)
+      if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0)
+        break;
   }
-  panic("bget: no buffers");
+  if(b == &bcache.head && (b = bufalloc()) == 0)
+    panic("bget: no buffers");
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Hand b to the driver for its device.
+static void
+devrw(struct buf *b)
+{
+  if(b->dev == RAMDEV)
+    ramdiskrw(b);
+  else
+    iderw(b);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -100,7 +129,7 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if((b->flags & B_VALID) == 0) {
-    iderw(b);
+    devrw(b);
   }
   return b;
 }
@@ -112,11 +141,12 @@ bwrite(struct buf *b)
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   b->flags |= B_DIRTY;
-  iderw(b);
+  devrw(b);
 }
 
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// Move to the head of the MRU list, or free it if the cache
+// has grown past NBUF.
 void
 brelse(struct buf *b)
 {
@@ -131,6 +161,12 @@ brelse(struct buf *b)
     // no one is waiting for it.
     b->next->prev = b->prev;
     b->prev->next = b->next;
+    if(bcache.nbuf > NBUF && (b->flags & B_DIRTY) == 0){
+      bcache.nbuf--;
+      kmem_cache_free(bcache.cache, b);
+      release(&bcache.lock);
+      return;
+    }
     b->next = bcache.head.next;
     b->prev = &bcache.head;
     bcache.head.next->prev = b;
@@ -7,6 +7,9 @@ struct buf {
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
+  struct buf *bnext; // next block in the same disk command
+  uint qtime;        // ticks when queued
+  uint qus;          // usecs() when queued
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
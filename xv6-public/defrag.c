@@ -0,0 +1,105 @@
+// defrag: report how fragmented files are and make them
+// contiguous.
+//   defrag [-n] [path...]
+// Directories are walked recursively; with no paths, the
+// whole file system from /.  -n only reports.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+
+int nflag;
+int nfiles, nbefore, nafter;
+
+void
+defragfile(char *path, int fd)
+{
+  struct fragstat fs;
+  int r;
+
+  if(fragstat(fd, &fs) < 0 || fs.nblocks == 0)
+    return;
+  nfiles++;
+  nbefore += fs.nextents;
+  if(nflag || fs.nextents <= 1){
+    nafter += fs.nextents;
+    printf(1, "%s: %d blocks, %d extents\n", path, fs.nblocks, fs.nextents);
+    return;
+  }
+  r = defrag(fd);
+  fragstat(fd, &fs);
+  nafter += fs.nextents;
+  if(r < 0)
+    printf(1, "%s: %d blocks, %d extents (no free run)\n", path,
+      fs.nblocks, fs.nextents);
+  else
+    printf(1, "%s: %d blocks, %d extents after moving %d\n", path,
+      fs.nblocks, fs.nextents, r);
+}
+
+void
+walk(char *path)
+{
+  char buf[128], *p;  // small: walk recurses on a one-page stack
+  int fd;
+  struct dirent de;
+  struct stat st;
+
+  // Don't follow symlinks: they could loop.
+  if((fd = openSymlinkFile(path, O_RDONLY, 0)) < 0){
+    printf(2, "defrag: cannot open %s\n", path);
+    return;
+  }
+  if(fstat(fd, &st) < 0){
+    printf(2, "defrag: cannot stat %s\n", path);
+    close(fd);
+    return;
+  }
+
+  switch(st.type){
+  case T_FILE:
+    defragfile(path, fd);
+    break;
+
+  case T_DIR:
+    defragfile(path, fd);
+    if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf){
+      printf(2, "defrag: path too long\n");
+      break;
+    }
+    strcpy(buf, path);
+    p = buf+strlen(buf);
+    if(p[-1] != '/')
+      *p++ = '/';
+    while(read(fd, &de, sizeof(de)) == sizeof(de)){
+      if(de.inum == 0 || strcmp(de.name, ".") == 0 || strcmp(de.name, "..") == 0)
+        continue;
+      memmove(p, de.name, DIRSIZ);
+      p[DIRSIZ] = 0;
+      walk(buf);
+    }
+    break;
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  i = 1;
+  if(argc > 1 && strcmp(argv[1], "-n") == 0){
+    nflag = 1;
+    i++;
+  }
+  if(i == argc)
+    walk("/");
+  for(; i < argc; i++)
+    walk(argv[i]);
+  printf(1, "defrag: %d files, %d extents before, %d after\n",
+    nfiles, nbefore, nafter);
+  exit();
+}
@@ -1,9 +1,17 @@
 struct buf;
 struct context;
+struct cpustat;
 struct file;
+struct files;
+struct fragstat;
 struct inode;
+struct kmem_cache;
+struct ioqueue;
+struct iostat;
+struct meminfo;
 struct pipe;
 struct proc;
+struct pstat;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
@@ -38,13 +46,17 @@ int             filewrite(struct file*, char*, int n);
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+struct inode*   ialloc(uint, short, uint);
+int             idefrag(struct inode*);
+void            ifragstat(struct inode*, struct fragstat*);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
+struct inode*   itext(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            iuntext(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*, int);
@@ -53,19 +65,41 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint, uint);
+int             futexwake(uint, int);
+
 // ide.c
 void            ideinit(void);
-void            ideintr(void);
+void            ideintr(int);
 void            iderw(struct buf*);
+void            iderwv(struct buf**, int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
 extern uchar    ioapicid;
 void            ioapicinit(void);
 
+// iosched.c
+void            ioq_init(struct ioqueue*, struct spinlock*, char*);
+void            ioq_add(struct ioqueue*, struct buf*);
+struct buf*     ioq_next(struct ioqueue*);
+void            ioq_done(struct ioqueue*, struct buf*);
+int             ioq_stat(int, struct iostat*);
+int             ioq_setpolicy(int, int);
+
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_zeroed(void);
+char*           kalloc_pages(int);
+void            kfree_pages(char*, int);
+void            getmeminfo(struct meminfo*);
 void            kfree(char*);
+void            kref(char*);
+int             krefs(char*);
+int             kzero(void);
+uint            kfreepages(void);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -78,9 +112,18 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
+void            lapiconeshot(uint);
+uint            lapicperiodic(uint);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
+// lockstat.c
+void            lockstatinit(void);
+void            lsacquired(struct spinlock*, uint, uint);
+void            lsinit(struct spinlock*);
+void            lsreleased(struct spinlock*);
+
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
@@ -91,11 +134,21 @@ void            end_op();
 extern int      ismp;
 void            mpinit(void);
 
+// ramdisk.c
+void            ramdiskrw(struct buf*);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
 
+// pagecache.c
+void            pcacheinit(void);
+char*           pcget(struct inode*, uint);
+void            pcinval(struct inode*);
+int             pcshrink(void);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -103,22 +156,37 @@ int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
+struct files*   allocfiles(void);
+int             clone(void(*)(void*), void*, void*);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
+int             getcpustats(struct cpustat*, int);
+int             getprocs(struct pstat*, int);
 int             growproc(int);
+int             join(void**);
 int             kill(int);
+struct proc*    kproc(char*, void(*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+void            boost(void);
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             schedtick(void);
+int             setaffinity(int, uint);
+int             setpriority(int, int);
 void            setproc(struct proc*);
+int             sharedvm(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+pde_t*          uservm(int, uint*);
+int             vmpinned(pde_t*, uint);
+int             vmrunning(pde_t*);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
 // swtch.S
@@ -133,6 +201,21 @@ void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// shm.c
+void            shminit(void);
+int             shmget(int, uint);
+int             shmat(int);
+int             shmdt(uint);
+int             shmcopy(pde_t*, pde_t*);
+void            shmdrop(pde_t*);
+int             shmvalid(pde_t*, uint, uint);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -148,18 +231,39 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(int);
+int             swapalloc(void);
+void            swapdup(uint);
+void            swapfree(uint);
+void            swapread(uint, char*);
+void            swapwrite(uint, char*);
+void            swapkick(void);
+int             swapwait(void);
+void            getswapinfo(struct meminfo*);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argptrw(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
+uint64          div64(uint64, uint, uint*);
+uint64          nsecs(void);
+void            pitwait(uint);
+void            runtimers(uint);
+int             sleepticks(uint);
 void            timerinit(void);
+uint            timernext(uint);
+extern uint     tsckhz;
+uint            usecs(void);
 
 // trap.c
+void            addticks(uint);
 void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
@@ -178,9 +282,14 @@ char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
+int             shareuvm(pde_t*, uint, char**, int);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(pde_t*, uint, int);
+int             uvmfault(pde_t*, uint, uint, int);
+int             pagefault(struct proc*, uint, int);
+int             uncow(pde_t*, uint);
+int             uvmpin(struct proc*, uint, uint, int);
+int             swapout(void);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
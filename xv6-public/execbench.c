@@ -0,0 +1,88 @@
+// execbench: cost of starting programs.
+//   execbench [iters]
+// Runs the pipeline cat README | grep the | wc, the way sh
+// would, iters times (default 20), with its output going to a
+// scratch file.  Reports the first run, when the programs'
+// pages are read from disk, apart from the rest, which should
+// find them in the page cache.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+char *cat[] = { "cat", "README", 0 };
+char *grep[] = { "grep", "the", 0 };
+char *wc[] = { "wc", 0 };
+char **cmds[] = { cat, grep, wc };
+
+#define NCMD (sizeof(cmds)/sizeof(cmds[0]))
+
+// Run the pipeline once, with its output to out.
+void
+run(int out)
+{
+  int i, in, p[2];
+
+  in = 0;
+  for(i = 0; i < NCMD; i++){
+    if(i < NCMD-1 && pipe(p) < 0){
+      printf(2, "execbench: pipe failed\n");
+      exit();
+    }
+    if(fork() == 0){
+      if(in != 0){
+        close(0);
+        dup(in);
+        close(in);
+      }
+      close(1);
+      dup(i < NCMD-1 ? p[1] : out);
+      if(i < NCMD-1){
+        close(p[0]);
+        close(p[1]);
+      }
+      exec(cmds[i][0], cmds[i]);
+      printf(2, "execbench: exec %s failed\n", cmds[i][0]);
+      exit();
+    }
+    if(in != 0)
+      close(in);
+    if(i < NCMD-1){
+      close(p[1]);
+      in = p[0];
+    }
+  }
+  for(i = 0; i < NCMD; i++)
+    wait();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int iters, i, out;
+  uint t0, first, rest;
+
+  iters = argc > 1 ? atoi(argv[1]) : 20;
+  if(iters < 2){
+    printf(2, "usage: execbench [iters (2 or more)]\n");
+    exit();
+  }
+  if((out = open("execbench.out", O_CREATE|O_WRONLY)) < 0){
+    printf(2, "execbench: cannot create execbench.out\n");
+    exit();
+  }
+
+  t0 = usecs();
+  run(out);
+  first = usecs() - t0;
+  t0 = usecs();
+  for(i = 1; i < iters; i++)
+    run(out);
+  rest = (usecs() - t0) / (iters - 1);
+
+  close(out);
+  unlink("execbench.out");
+  printf(1, "execbench: first run %d us, then %d us per run\n", first, rest);
+  exit();
+}
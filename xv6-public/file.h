@@ -14,8 +14,13 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *prev; // icache list
+  struct inode *next;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint lastblock;     // last block allocated to it, hint for the next
+  int npcache;        // pages of it in the page cache
+  int ntext;          // processes running it; writes fail while > 0
 
   short type;         // copy of disk inode
   short major;
@@ -25,16 +30,18 @@ struct inode {
   //uint addrs[NDIRECT+1]; //fs.c에서만 사용
   //uint addrs[TINDIRECTIDX+1]; //proj3
   uint addrs[NDIRECT+3];
+  uint flags;
   uint isSymlink;
 };
 
 // table mapping major device number to
 // device functions
 struct devsw {
-  int (*read)(struct inode*, char*, int);
+  int (*read)(struct inode*, char*, uint, int);
   int (*write)(struct inode*, char*, int);
 };
 
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define LOCKSTATDEV 2
@@ -0,0 +1,91 @@
+// forkbench: cost of fork in large processes.
+//   forkbench [maxmb [iters]]
+// Grows itself to 0, 1, 4, ... up to maxmb megabytes (default
+// 16), touching every page, and at each size times iters
+// (default 20) fork+exit, fork+exec of a trivial program, and
+// fork with a child that writes every page.  With
+// copy-on-write fork the first two should hardly depend on
+// the size; the last pays for the copies.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MB (1024*1024)
+
+char *mem;
+int size, iters;
+
+// Time iters forks whose children run child, in us per fork.
+uint
+timefork(void (*child)(void))
+{
+  uint t0;
+  int i;
+
+  t0 = usecs();
+  for(i = 0; i < iters; i++){
+    if(fork() == 0){
+      child();
+      exit();
+    }
+    wait();
+  }
+  return (usecs() - t0) / iters;
+}
+
+void
+justexit(void)
+{
+}
+
+void
+execs(void)
+{
+  char *argv[] = { "forkbench", "-x", 0 };
+
+  exec("forkbench", argv);
+  printf(2, "forkbench: exec failed\n");
+}
+
+void
+writeall(void)
+{
+  int i;
+
+  for(i = 0; i < size; i += 4096)
+    mem[i]++;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxmb, mb, grow, i;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit();
+  maxmb = argc > 1 ? atoi(argv[1]) : 16;
+  iters = argc > 2 ? atoi(argv[2]) : 20;
+  if(maxmb < 0 || iters < 1){
+    printf(2, "usage: forkbench [maxmb [iters]]\n");
+    exit();
+  }
+
+  mem = sbrk(0);
+  size = 0;
+  printf(1, "size\tfork+exit\tfork+exec\tfork+write (us)\n");
+  for(mb = 0; mb <= maxmb; mb = mb ? mb*4 : 1){
+    grow = mb*MB - size;
+    if(sbrk(grow) == (char*)-1){
+      printf(2, "forkbench: out of memory at %d MB\n", mb);
+      break;
+    }
+    for(i = size; i < mb*MB; i += 4096)
+      mem[i] = 1;
+    size = mb*MB;
+    printf(1, "%d MB\t%d\t\t", mb, timefork(justexit));
+    printf(1, "%d\t\t", timefork(execs));
+    printf(1, "%d\n", timefork(writeall));
+  }
+  exit();
+}
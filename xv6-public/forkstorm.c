@@ -0,0 +1,73 @@
+// forkstorm: allocator scaling under parallel forks.
+//   forkstorm [maxprocs [iters]]
+// Runs 1, 2, ... up to maxprocs (default 4) processes at once,
+// each forking iters (default 200) children that touch a few
+// pages of a 64 KB heap and exit.  Every fork, page fault and
+// exit allocates or frees pages, so forks per second should
+// grow with the number of processes, up to the number of CPUs,
+// unless kalloc serializes them.  Run it under make CPUS=1,
+// 2, 4 ... to compare.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define HEAP (64*1024)
+
+void
+storm(int iters)
+{
+  char *mem;
+  int i, j;
+
+  if((mem = sbrk(HEAP)) == (char*)-1){
+    printf(2, "forkstorm: out of memory\n");
+    exit();
+  }
+  for(j = 0; j < HEAP; j += 4096)
+    mem[j] = 1;
+  for(i = 0; i < iters; i++){
+    if(fork() == 0){
+      for(j = 0; j < HEAP; j += 4*4096)
+        mem[j]++;
+      exit();
+    }
+    wait();
+  }
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxprocs, iters, n, i;
+  uint t0, t, rate, rate1;
+
+  maxprocs = argc > 1 ? atoi(argv[1]) : 4;
+  iters = argc > 2 ? atoi(argv[2]) : 200;
+  if(maxprocs < 1 || maxprocs > 16 || iters < 1){
+    printf(2, "usage: forkstorm [maxprocs (1-16) [iters]]\n");
+    exit();
+  }
+
+  rate1 = 0;
+  for(n = 1; n <= maxprocs; n++){
+    t0 = usecs();
+    for(i = 0; i < n; i++)
+      if(fork() == 0)
+        storm(iters);
+    for(i = 0; i < n; i++)
+      wait();
+    t = (usecs() - t0) / 1000;
+    if(t == 0)
+      t = 1;
+    rate = n * iters * 1000 / t;
+    if(n == 1)
+      rate1 = rate;
+    printf(1, "forkstorm: %d procs: %d forks/s", n, rate);
+    if(rate1 > 0)
+      printf(1, ", %d.%d times 1 proc", rate / rate1, rate * 10 / rate1 % 10);
+    printf(1, "\n");
+  }
+  exit();
+}
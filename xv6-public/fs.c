@@ -14,8 +14,8 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -52,18 +52,36 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// The run of free blocks idefrag is filling, [start, end).
+// balloc leaves it alone, though it is free in the bitmap
+// until the blocks arrive (see idefrag).  Set and read with
+// the run's bitmap block locked.
+static struct {
+  struct sleeplock lock;  // one idefrag at a time
+  uint start;
+  uint end;
+} dfrun;
+
+// Allocate a zeroed disk block, the first free one at or
+// after goal, searching group by group and wrapping around.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal)
 {
-  int b, bi, m;
+  int g, i, b, bi, m;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+  if(goal < sb.groupstart || goal >= GSTART(sb.ngroups, sb))
+    goal = sb.groupstart;
+  // Visit goal's group twice: from goal, and at the end
+  // from its start.
+  for(i = 0; i <= sb.ngroups; i++){
+    g = (BGROUP(goal, sb) + i) % sb.ngroups;
+    b = GSTART(g, sb);
+    bp = bread(dev, b);
+    for(bi = i ? 0 : goal - b; bi < BPB && b + bi < sb.size; bi++){
       m = 1 << (bi % 8);
+      if(b + bi >= dfrun.start && b + bi < dfrun.end)
+        continue;
       if((bp->data[bi/8] & m) == 0){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
@@ -77,6 +95,23 @@ balloc(uint dev)
   panic("balloc: out of blocks");
 }
 
+// Mark free block b in use.
+static void
+bmark(int dev, uint b)
+{
+  struct buf *bp;
+  int bi, m;
+
+  bp = bread(dev, BBLOCK(b, sb));
+  bi = (b - sb.groupstart) % BPB;
+  m = 1 << (bi % 8);
+  if(bp->data[bi/8] & m)
+    panic("bmark: block in use");
+  bp->data[bi/8] |= m;
+  log_write(bp);
+  brelse(bp);
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -84,8 +119,10 @@ bfree(int dev, uint b)
   struct buf *bp;
   int bi, m;
 
+  if(b < sb.groupstart || b >= sb.size)
+    panic("bfree: not a data block");
   bp = bread(dev, BBLOCK(b, sb));
-  bi = b % BPB;
+  bi = (b - sb.groupstart) % BPB;
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
@@ -101,9 +138,9 @@ bfree(int dev, uint b)
 // its size, the number of links referring to it, and the
 // list of blocks holding the file's content.
 //
-// The inodes are laid out sequentially on disk at
-// sb.startinode. Each inode has a number, indicating its
-// position on the disk.
+// The inodes are laid out in slices of sb.ipg, one slice
+// at the start of each block group. Each inode has a number,
+// indicating its position on the disk (see IBLOCK).
 //
 // The kernel keeps a cache of in-use inodes in memory
 // to provide a place for synchronizing access
@@ -159,51 +196,75 @@ bfree(int dev, uint b)
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
 //
+// Entries come from an object cache, as many as are in use.
+// Up to NINODE more, no longer in use, stay cached in case
+// they are wanted again, the least recently used going first.
+//
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum, prev and next.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct kmem_cache *cache;
+  struct inode head;  // all entries; head.next is most recently used
+  int nunused;        // entries with ref 0
 } icache;
 
 void
 iinit(int dev)
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  initsleeplock(&dfrun.lock, "dfrun");
+  icache.cache = kmem_cache_create("inode", sizeof(struct inode));
+  icache.head.prev = &icache.head;
+  icache.head.next = &icache.head;
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
- inodestart %d bmap start %d\n", sb.size, sb.nblocks,
-          sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
-          sb.bmapstart);
+ groupstart %d ngroups %d ipg %d logdev %d swapstart %d nswap %d\n",
+          sb.size, sb.nblocks, sb.ninodes, sb.nlog, sb.logstart,
+          sb.groupstart, sb.ngroups, sb.ipg, sb.logdev, sb.swapstart,
+          sb.nswap);
 }
 
 static struct inode* iget(uint dev, uint inum);
 
 //PAGEBREAK!
-// Allocate an inode on device dev.
+// Allocate an inode on device dev, to be linked into
+// directory parent.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode.
+//
+// A file goes into its directory's block group.  A new
+// directory goes into the next group after the previous new
+// directory, which spreads directory trees (and the files
+// that will follow them) over the disk.
 struct inode*
-ialloc(uint dev, short type)
+ialloc(uint dev, short type, uint parent)
 {
-  int inum;
+  static uint dirgroup;
+  int g, i, inum;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
+  if(type == T_DIR)
+    g = dirgroup++ % sb.ngroups;
+  else
+    g = IGROUP(parent, sb);
+  for(i = 0; i < sb.ninodes; i++){
+    inum = (g*sb.ipg + i) % sb.ninodes;
+    if(inum == 0)
+      continue;
     bp = bread(dev, IBLOCK(inum, sb)); //여기서 lock 잡힘
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
+      // Files and directories start out inline;
+      // writei moves them to blocks when they outgrow addrs.
+      if(type == T_FILE || type == T_DIR)
+        dip->flags = I_INLINE;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
       return iget(dev, inum);
@@ -231,41 +292,80 @@ iupdate(struct inode *ip)
   dip->nlink = ip->nlink;
   dip->size = ip->size;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  dip->flags = ip->flags;
   log_write(bp);
   brelse(bp);
 }
 
+// Move ip to the front of the icache list.
+// Caller must hold icache.lock.
+static void
+imru(struct inode *ip)
+{
+  if(ip->next){
+    ip->next->prev = ip->prev;
+    ip->prev->next = ip->next;
+  }
+  ip->next = icache.head.next;
+  ip->prev = &icache.head;
+  icache.head.next->prev = ip;
+  icache.head.next = ip;
+}
+
+// Least recently used entry with ref 0, or 0.
+// Caller must hold icache.lock.
+static struct inode*
+iunused(void)
+{
+  struct inode *ip;
+
+  for(ip = icache.head.prev; ip != &icache.head; ip = ip->prev)
+    if(ip->ref == 0)
+      return ip;
+  return 0;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&icache.lock);
 
-  // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  // Is the inode already cached?  An entry no longer in use
+  // may still hold it: if it was freed since, valid is 0.
+  for(ip = icache.head.next; ip != &icache.head; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        icache.nunused--;
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Allocate a new entry, or recycle an unused one.
+  if((ip = kmem_cache_alloc(icache.cache)) != 0){
+    initsleeplock(&ip->lock, "inode");
+    ip->npcache = 0;
+    ip->next = 0;
+  } else if((ip = iunused()) != 0){
+    icache.nunused--;
+    pcinval(ip);
+  } else
     panic("iget: no inodes");
+  imru(ip);
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->lastblock = 0;
+  ip->flags = 0;
+  ip->isSymlink = 0;
+  ip->ntext = 0;
   release(&icache.lock);
 
   return ip;
@@ -282,6 +382,31 @@ idup(struct inode *ip)
   return ip;
 }
 
+// ip is the program of one more process, which pages it in
+// as it runs (see pagefault), so writes to it must fail until
+// iuntext: the process would run a mix of old and new code.
+// The caller holds a reference to ip, and keeps it until
+// iuntext, so itrunc cannot happen either.
+// Returns ip to enable ip = itext(idup(ip1)).
+struct inode*
+itext(struct inode *ip)
+{
+  acquire(&icache.lock);
+  ip->ntext++;
+  release(&icache.lock);
+  return ip;
+}
+
+void
+iuntext(struct inode *ip)
+{
+  acquire(&icache.lock);
+  if(ip->ntext < 1)
+    panic("iuntext");
+  ip->ntext--;
+  release(&icache.lock);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -304,6 +429,7 @@ ilock(struct inode *ip)
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->flags = dip->flags;
     brelse(bp);
     ip->valid = 1;
     if(ip->type == 0)
@@ -323,7 +449,7 @@ iunlock(struct inode *ip) // lock 풀기. reference 없으면 panic
 
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
-// be recycled.
+// be recycled, or freed if NINODE others are unused already.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -331,6 +457,8 @@ iunlock(struct inode *ip) // lock 풀기. reference 없으면 panic
 void
 iput(struct inode *ip)
 {
+  struct inode *old;
+
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
     acquire(&icache.lock); //inode cache 오래 잡으면 안됨..
@@ -347,7 +475,17 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref == 0){
+    imru(ip);
+    if(++icache.nunused > NINODE){
+      old = iunused();
+      old->next->prev = old->prev;
+      old->prev->next = old->next;
+      icache.nunused--;
+      pcinval(old);
+      kmem_cache_free(icache.cache, old);
+    }
+  }
   release(&icache.lock);
 }
 
@@ -366,6 +504,22 @@ iunlockput(struct inode *ip)
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
+//
+// A small file or directory (I_INLINE) instead keeps its
+// content, up to NINLINE bytes, in ip->addrs itself, so
+// reading it needs no data block; see readi and writei.
+
+// Allocate a block for ip: right after the last block it got,
+// or at the start of the data area of its group.
+static uint
+iballoc(struct inode *ip)
+{
+  uint goal;
+
+  goal = ip->lastblock ? ip->lastblock + 1 : GDATA(IGROUP(ip->inum, sb), sb);
+  ip->lastblock = balloc(ip->dev, goal);
+  return ip->lastblock;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -403,9 +557,12 @@ bmap(struct inode *ip, uint bn) // 몇 번째 블럭 가져올지
   uint addr, *a;
   struct buf *bp; //triple indirect때는 bp3까지 사용
 
+  if(ip->flags & I_INLINE)
+    panic("bmap: inline");
+
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = iballoc(ip);
     return addr;
   }
   bn -= NDIRECT;
@@ -414,11 +571,11 @@ bmap(struct inode *ip, uint bn) // 몇 번째 블럭 가져올지
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = iballoc(ip);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -431,14 +588,14 @@ bmap(struct inode *ip, uint bn) // 몇 번째 블럭 가져올지
   if(bn < N2INDIRECT) { 
 
     if((addr = ip->addrs[DINDIRECTIDX]) == 0) {
-      ip->addrs[DINDIRECTIDX] = addr = balloc(ip->dev);
+      ip->addrs[DINDIRECTIDX] = addr = iballoc(ip);
     }
     bp = bread(ip->dev, addr); //double indirect block read
     a = (uint*)bp->data;
 
 
     if((addr = a[bn/NINDIRECT]) == 0) { // 중간(2차) indirect block이 없으면 
-      a[bn/NINDIRECT] = addr = balloc(ip->dev);
+      a[bn/NINDIRECT] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -449,7 +606,7 @@ bmap(struct inode *ip, uint bn) // 몇 번째 블럭 가져올지
 
 
     if((addr = a[bn%NINDIRECT]) == 0) { // target block이 없으면
-      a[bn%NINDIRECT] = addr = balloc(ip->dev);
+      a[bn%NINDIRECT] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -461,7 +618,7 @@ bmap(struct inode *ip, uint bn) // 몇 번째 블럭 가져올지
   if(bn < N3INDIRECT) {
 
     if((addr = ip->addrs[TINDIRECTIDX]) == 0) { // 맨 바깥(1차) triple indirect block이 없으면
-      ip->addrs[TINDIRECTIDX] = addr = balloc(ip->dev);
+      ip->addrs[TINDIRECTIDX] = addr = iballoc(ip);
     }
     bp = bread(ip->dev, addr); //1차 indirect block read
     a = (uint*)bp->data;
@@ -469,7 +626,7 @@ bmap(struct inode *ip, uint bn) // 몇 번째 블럭 가져올지
 
 
     if((addr = a[bn/N2INDIRECT]) == 0) { // 중간(2차) indirect block이 없으면 
-      a[bn/N2INDIRECT] = addr = balloc(ip->dev);
+      a[bn/N2INDIRECT] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -481,7 +638,7 @@ bmap(struct inode *ip, uint bn) // 몇 번째 블럭 가져올지
 
 
     if((addr = a[bn/NINDIRECT]) == 0) {
-      a[(bn)/NINDIRECT] = addr = balloc(ip->dev);
+      a[(bn)/NINDIRECT] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -491,7 +648,7 @@ bmap(struct inode *ip, uint bn) // 몇 번째 블럭 가져올지
 
 
     if((addr = a[bn%NINDIRECT]) == 0) { 
-      a[bn%NINDIRECT] = addr = balloc(ip->dev);
+      a[bn%NINDIRECT] = addr = iballoc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -541,6 +698,14 @@ itrunc(struct inode *ip)
   struct buf *bp1, *bp2, *bp3;
   uint *a1, *a2, *a3;
 
+  pcinval(ip);
+  if(ip->flags & I_INLINE){
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -637,7 +802,7 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
       return -1;
-    return devsw[ip->major].read(ip, dst, n);
+    return devsw[ip->major].read(ip, dst, off, n);
   }
 
   if(off > ip->size || off + n < off)
@@ -645,6 +810,11 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  if(ip->flags & I_INLINE){
+    memmove(dst, (char*)ip->addrs + off, n);
+    return n;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
@@ -654,6 +824,27 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   return n;
 }
 
+// Move the content of inline ip into a data block,
+// so that it can grow past NINLINE bytes.
+// Caller must hold ip->lock.
+static void
+uninline(struct inode *ip)
+{
+  char data[NINLINE];
+  struct buf *bp;
+
+  memmove(data, ip->addrs, ip->size);
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  ip->flags &= ~I_INLINE;
+  if(ip->size > 0){
+    bp = bread(ip->dev, bmap(ip, 0));
+    memmove(bp->data, data, ip->size);
+    log_write(bp);
+    brelse(bp);
+  }
+  iupdate(ip);
+}
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
@@ -669,10 +860,24 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return devsw[ip->major].write(ip, src, n);
   }
 
+  if(ip->ntext > 0)
+    return -1;  // a running program (see itext)
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  pcinval(ip);
+
+  if(ip->flags & I_INLINE){
+    if(off + n <= NINLINE){
+      memmove((char*)ip->addrs + off, src, n);
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    uninline(ip);
+  }
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -689,6 +894,197 @@ writei(struct inode *ip, char *src, uint off, uint n)
   return n;
 }
 
+//PAGEBREAK!
+// Defragmentation
+
+// Find where the address of ip's block bn is kept, without
+// allocating anything.  Returns a pointer into ip->addrs with
+// *bpp set to 0, or into the indirect block returned locked
+// in *bpp.  Returns 0 if an indirect block on the way is
+// missing.  Caller must hold ip->lock.
+static uint*
+bslot(struct inode *ip, uint bn, struct buf **bpp)
+{
+  uint addr, *slot;
+  int level;
+  struct buf *bp;
+
+  *bpp = 0;
+  if(bn < NDIRECT)
+    return &ip->addrs[bn];
+  bn -= NDIRECT;
+  if(bn < NINDIRECT){
+    slot = &ip->addrs[NDIRECT];
+    level = 1;
+  } else if((bn -= NINDIRECT) < N2INDIRECT){
+    slot = &ip->addrs[DINDIRECTIDX];
+    level = 2;
+  } else if((bn -= N2INDIRECT) < N3INDIRECT){
+    slot = &ip->addrs[TINDIRECTIDX];
+    level = 3;
+  } else
+    panic("bslot: out of range");
+
+  bp = 0;
+  for(; level > 0; level--){
+    addr = *slot;
+    if(bp)
+      brelse(bp);
+    if(addr == 0)
+      return 0;
+    bp = bread(ip->dev, addr);
+    if(level == 3)
+      slot = (uint*)bp->data + bn/N2INDIRECT;
+    else if(level == 2)
+      slot = (uint*)bp->data + bn%N2INDIRECT/NINDIRECT;
+    else
+      slot = (uint*)bp->data + bn%NINDIRECT;
+  }
+  *bpp = bp;
+  return slot;
+}
+
+// Address of ip's block bn, 0 if it has none.
+static uint
+blookup(struct inode *ip, uint bn)
+{
+  struct buf *bp;
+  uint *slot, addr;
+
+  if((slot = bslot(ip, bn, &bp)) == 0)
+    return 0;
+  addr = *slot;
+  if(bp)
+    brelse(bp);
+  return addr;
+}
+
+// Count ip's data blocks and the runs of consecutive
+// block numbers (extents) they form.  Inline data, devices
+// and symlinks have no blocks.  Caller must hold ip->lock.
+void
+ifragstat(struct inode *ip, struct fragstat *st)
+{
+  uint bn, n, addr, prev;
+
+  st->nblocks = st->nextents = 0;
+  if((ip->type != T_FILE && ip->type != T_DIR) || (ip->flags & I_INLINE))
+    return;
+  n = (ip->size + BSIZE - 1) / BSIZE;
+  prev = 0;
+  for(bn = 0; bn < n; bn++){
+    if((addr = blookup(ip, bn)) == 0)
+      continue;
+    st->nblocks++;
+    if(prev == 0 || addr != prev + 1)
+      st->nextents++;
+    prev = addr;
+  }
+}
+
+// Find n free blocks in a row inside one group, preferring
+// goal's group, and reserve them as dfrun.  Returns the first,
+// or 0 if there is no such run.  Caller must hold dfrun.lock.
+static uint
+breserve(uint dev, uint n, uint goal)
+{
+  int g, i, bi, start, m;
+  struct buf *bp;
+
+  for(i = 0; i < sb.ngroups; i++){
+    g = (BGROUP(goal, sb) + i) % sb.ngroups;
+    bp = bread(dev, GSTART(g, sb));
+    start = GDATA(g, sb) - GSTART(g, sb);
+    for(bi = start; bi < BPB && GSTART(g, sb) + bi < sb.size; bi++){
+      m = 1 << (bi % 8);
+      if(bp->data[bi/8] & m){
+        start = bi + 1;
+        continue;
+      }
+      if(bi - start + 1 < n)
+        continue;
+      dfrun.start = GSTART(g, sb) + start;
+      dfrun.end = dfrun.start + n;
+      brelse(bp);
+      return dfrun.start;
+    }
+    brelse(bp);
+  }
+  return 0;
+}
+
+// Blocks moved per transaction.  Each moved block dirties at
+// most its new copy, its old bitmap block and the block that
+// points to it; all of them share the bitmap block of the run.
+#define DEFRAGCHUNK ((MAXOPBLOCKS-1)/3)
+
+// Move ip's data blocks into one contiguous run of free
+// blocks near its group.  Works in small transactions,
+// unlocking ip between them, so the file stays usable;
+// a block written meanwhile is moved with its new content.
+// The run is reserved only in memory, and each block of it
+// marked in use in the transaction that moves a block there,
+// so a crash part way leaves no block of it allocated to
+// nothing.  Returns the number of blocks moved, or -1 if
+// there is no free run big enough.  Caller must not hold
+// ip->lock.
+int
+idefrag(struct inode *ip)
+{
+  struct fragstat st;
+  struct buf *bp, *from, *to;
+  uint bn, n, run, *slot;
+  int i;
+
+  ilock(ip);
+  ifragstat(ip, &st);
+  n = (ip->size + BSIZE - 1) / BSIZE;
+  iunlock(ip);
+  if(st.nextents <= 1)
+    return 0;
+
+  acquiresleep(&dfrun.lock);
+  if((run = breserve(ip->dev, n, GDATA(IGROUP(ip->inum, sb), sb))) == 0){
+    releasesleep(&dfrun.lock);
+    return -1;
+  }
+
+  for(bn = 0; bn < n; ){
+    begin_op();
+    ilock(ip);
+    for(i = 0; i < DEFRAGCHUNK && bn < n; i++, bn++){
+      if((slot = bslot(ip, bn, &bp)) == 0 || *slot == 0){
+        // A hole: its place in the run stays free.
+        if(bp)
+          brelse(bp);
+        continue;
+      }
+      bmark(ip->dev, run + bn);
+      from = bread(ip->dev, *slot);
+      to = bread(ip->dev, run + bn);
+      memmove(to->data, from->data, BSIZE);
+      log_write(to);
+      brelse(to);
+      brelse(from);
+      bfree(ip->dev, *slot);
+      *slot = run + bn;
+      if(bp){
+        log_write(bp);
+        brelse(bp);
+      } else
+        iupdate(ip);
+    }
+    ip->lastblock = run + bn - 1;
+    iunlock(ip);
+    end_op();
+  }
+  bp = bread(ip->dev, BBLOCK(run, sb));
+  dfrun.start = dfrun.end = 0;
+  brelse(bp);
+  releasesleep(&dfrun.lock);
+  return n;
+}
+
 //PAGEBREAK!
 // Directories
 
@@ -805,11 +1201,16 @@ static struct inode*
 namex(char *path, int nameiparent, char *name, int findRealfile)
 {
   struct inode *ip, *next;
+  struct files *f;
   char symlinkTo[200];
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO); // reference 올라감
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    f = myproc()->files;
+    acquire(&f->lock);  // a thread may be changing it
+    ip = idup(f->cwd);
+    release(&f->lock);
+  }
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
@@ -4,10 +4,23 @@
 
 #define ROOTINO 1  // root i-number
 #define BSIZE 512  // block size
+#define BPP (4096/BSIZE)  // blocks per page of swap
 
 // Disk layout:
-// [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+// [ boot block | super block | log | swap | group 0 | group 1 | ... ]
+//
+// The swap area holds nswap pages that kswapd pages out, each
+// in BPP consecutive blocks (see swap.c).
+//
+// The rest of the disk is divided into block groups of BPB
+// blocks, so that one bitmap block covers a whole group:
+// [ free bit map | ipg/IPB inode blocks | data blocks ]
+// Keeping a file's inode, its data and its directory in the
+// same group keeps the disk head from travelling.
+//
+// The log can instead live on a separate device (sb.logdev), in
+// which case it is left out of this layout and starts at
+// sb.logstart on that device.
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -17,8 +30,12 @@ struct superblock {
   uint ninodes;      // Number of inodes.
   uint nlog;         // Number of log blocks
   uint logstart;     // Block number of first log block
-  uint inodestart;   // Block number of first inode block
-  uint bmapstart;    // Block number of first free map block
+  uint groupstart;   // Block number of first block group
+  uint ngroups;      // Number of block groups
+  uint ipg;          // Inodes per group, a multiple of IPB
+  uint logdev;       // Device holding the log, 0 if it is this device
+  uint swapstart;    // Block number of first swap block
+  uint nswap;        // Number of pages of swap space
 };
 
 //#define NDIRECT 12
@@ -44,20 +61,34 @@ struct dinode {
   //uint addrs[NDIRECT+1];   // Data block addresses
   //uint addrs[TINDIRECTIDX+1]; //proj3
   uint addrs[NDIRECT+3]; //proj3
-  uint isSymlink; //proj3
+  uint flags;           // I_INLINE
 };
 
+// Inode flags.
+#define I_INLINE 0x1  // data lives in addrs, not in data blocks
+
+// Bytes of data an inline inode can hold.
+#define NINLINE (sizeof(((struct dinode*)0)->addrs))
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
-// Block containing inode i
-#define IBLOCK(i, sb)     ((i) / IPB + sb.inodestart)
-
-// Bitmap bits per block
+// Bitmap bits per block, and blocks per group
 #define BPB           (BSIZE*8)
 
-// Block of free map containing bit for block b
-#define BBLOCK(b, sb) (b/BPB + sb.bmapstart)
+// First block of group g, which holds the group's free map
+#define GSTART(g, sb)     ((sb).groupstart + (g)*BPB)
+
+// First data block of group g
+#define GDATA(g, sb)      (GSTART(g, sb) + 1 + (sb).ipg/IPB)
+
+// Group of inode i, and block containing inode i
+#define IGROUP(i, sb)     ((i) / (sb).ipg)
+#define IBLOCK(i, sb)     (GSTART(IGROUP(i, sb), sb) + 1 + (i) % (sb).ipg / IPB)
+
+// Group of block b, and block of free map containing bit for b
+#define BGROUP(b, sb)     (((b) - (sb).groupstart) / BPB)
+#define BBLOCK(b, sb)     GSTART(BGROUP(b, sb), sb)
 
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
@@ -0,0 +1,82 @@
+// Futexes: sleeping on a word of user memory.
+// A user-space lock handles the uncontended case with atomic
+// instructions alone, and calls futexwait to sleep until the
+// word changes and futexwake to wake sleepers after changing
+// it.  Sleepers wait on the kernel address of the word, so
+// threads sharing memory find each other, as do processes
+// sharing a shared memory segment.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+
+// Held from checking the word to sleeping, and while waking,
+// so that a wake between the two is not missed.
+struct spinlock futexlock;
+
+void
+futexinit(void)
+{
+  initlock(&futexlock, "futex");
+}
+
+// Kernel address of the aligned user word at addr, or 0.
+static uint*
+futexaddr(uint addr)
+{
+  struct proc *p = myproc();
+  char *ka;
+
+  if(addr % 4 != 0)
+    return 0;
+  if((addr >= p->sz || addr+4 > p->sz) && !shmvalid(p->pgdir, addr, 4))
+    return 0;
+  // Sleepers and wakers must agree on the page, so make it
+  // present and private now rather than at the next write,
+  // and keep it from being paged out while sleeping.
+  if(uvmpin(p, addr, 4, 1) < 0)
+    return 0;
+  if((ka = uva2ka(p->pgdir, (char*)addr)) == 0)
+    return 0;
+  return (uint*)(ka + addr % PGSIZE);
+}
+
+// Sleep until woken by futexwake, if the word at addr still
+// holds val.  Returns 0 if it slept, -1 if the word had
+// changed or the process was killed.  Callers must recheck
+// the word: a wake may have been meant for another sleeper.
+int
+futexwait(uint addr, uint val)
+{
+  uint *w;
+
+  if((w = futexaddr(addr)) == 0)
+    return -1;
+  acquire(&futexlock);
+  if(*w != val || myproc()->killed){
+    release(&futexlock);
+    return -1;
+  }
+  sleep(w, &futexlock);
+  release(&futexlock);
+  return 0;
+}
+
+// Wake at most n processes sleeping on the word at addr.
+// Returns the number woken.
+int
+futexwake(uint addr, int n)
+{
+  uint *w;
+  int woken;
+
+  if((w = futexaddr(addr)) == 0)
+    return -1;
+  acquire(&futexlock);
+  woken = wakeupn(w, n);
+  release(&futexlock);
+  return woken;
+}
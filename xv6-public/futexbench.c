@@ -0,0 +1,98 @@
+// futexbench: cost of futex-based mutexes and conditions.
+//   futexbench [nthreads [iters]]
+// Times iters lock/unlock pairs by one thread (the
+// uncontended case, which should make no system calls), then
+// nthreads threads (default 4) each incrementing a shared
+// counter iters times under the mutex, then a producer and a
+// consumer handing iters items over a condition variable.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MAXTHREADS 16
+
+struct mutex m;
+struct cond nonempty, nonfull;
+int counter, full, iters;
+
+void
+incr(void *arg)
+{
+  int i;
+
+  for(i = 0; i < iters; i++){
+    mutex_lock(&m);
+    counter++;
+    mutex_unlock(&m);
+  }
+  exit();
+}
+
+void
+consume(void *arg)
+{
+  int i;
+
+  for(i = 0; i < iters; i++){
+    mutex_lock(&m);
+    while(!full)
+      cond_wait(&nonempty, &m);
+    full = 0;
+    counter++;
+    cond_signal(&nonfull);
+    mutex_unlock(&m);
+  }
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nthreads, i;
+  uint t0, t;
+
+  nthreads = argc > 1 ? atoi(argv[1]) : 4;
+  iters = argc > 2 ? atoi(argv[2]) : 100000;
+  if(nthreads < 1 || nthreads > MAXTHREADS || iters < 1){
+    printf(2, "usage: futexbench [nthreads (1-%d) [iters]]\n", MAXTHREADS);
+    exit();
+  }
+
+  t0 = usecs();
+  for(i = 0; i < iters; i++){
+    mutex_lock(&m);
+    mutex_unlock(&m);
+  }
+  t = usecs() - t0;
+  printf(1, "uncontended: %d ns per lock/unlock\n", t * 1000 / iters);
+
+  counter = 0;
+  t0 = usecs();
+  for(i = 0; i < nthreads; i++)
+    if(thread_create(incr, 0) < 0)
+      printf(2, "futexbench: thread_create failed\n");
+  while(thread_join() >= 0)
+    ;
+  t = (usecs() - t0) / 1000;
+  printf(1, "%d threads: %d increments in %d ms%s\n", nthreads, counter, t,
+    counter == nthreads * iters ? "" : " (WRONG)");
+
+  counter = full = 0;
+  t0 = usecs();
+  if(thread_create(consume, 0) < 0)
+    printf(2, "futexbench: thread_create failed\n");
+  for(i = 0; i < iters; i++){
+    mutex_lock(&m);
+    while(full)
+      cond_wait(&nonfull, &m);
+    full = 1;
+    cond_signal(&nonempty);
+    mutex_unlock(&m);
+  }
+  thread_join();
+  t = usecs() - t0;
+  printf(1, "handoff: %d items, %d us each%s\n", counter, t / iters,
+    counter == iters ? "" : " (WRONG)");
+  exit();
+}
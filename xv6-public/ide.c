@@ -5,13 +5,15 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "iostat.h"
+#include "iosched.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -24,112 +26,190 @@
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
-// You must hold idelock while manipulating queue.
+// Each IDE channel has its own registers, interrupt line and
+// request queue, so the two channels can have requests in
+// flight at the same time.  Disks 0 and 1 are the master and
+// slave of the primary channel; disk 2 is the master of the
+// secondary channel, used for an external log (see LOGDEV).
+//
+// The I/O scheduler (iosched.c) orders waiting bufs and groups
+// bufs for consecutive blocks into one disk command.  active is
+// the first buf of the command in flight, with the rest chained
+// through bnext; cur is the buf whose sector the disk will
+// interrupt for next.
+// You must hold the channel's lock while manipulating its queue.
+struct idechan {
+  struct spinlock lock;
+  struct ioqueue q;
+  struct buf *active;
+  struct buf *cur;
+  ushort base;       // command block registers
+  ushort ctl;        // device control register
+  int irq;
+  int havedisk[2];   // master, slave present?
+};
 
-static struct spinlock idelock;
-static struct buf *idequeue;
+static struct idechan chans[] = {
+  { .base = 0x1f0, .ctl = 0x3f6, .irq = IRQ_IDE },
+  { .base = 0x170, .ctl = 0x376, .irq = IRQ_IDE2 },
+};
 
-static int havedisk1;
-static void idestart(struct buf*);
+static void idenext(struct idechan*);
 
 // Wait for IDE disk to become ready.
 static int
-idewait(int checkerr)
+idewait(struct idechan *ch, int checkerr)
 {
   int r;
 
-  while(((r = inb(0x1f7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
+  while(((r = inb(ch->base+7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
     ;
   if(checkerr && (r & (IDE_DF|IDE_ERR)) != 0)
     return -1;
   return 0;
 }
 
+// Check if the given drive of the channel is present.
+static int
+ideprobe(struct idechan *ch, int drive)
+{
+  int i, r;
+
+  outb(ch->base+6, 0xe0 | (drive<<4));
+  for(i=0; i<1000; i++){
+    r = inb(ch->base+7);
+    if(r != 0 && r != 0xff)
+      return 1;
+  }
+  return 0;
+}
+
 void
 ideinit(void)
 {
-  int i;
+  struct idechan *ch;
 
-  initlock(&idelock, "ide");
-  ioapicenable(IRQ_IDE, ncpu - 1);
-  idewait(0);
+  initlock(&chans[0].lock, "ide");
+  initlock(&chans[1].lock, "ide2");
+  ioq_init(&chans[0].q, &chans[0].lock, "ide");
+  ioq_init(&chans[1].q, &chans[1].lock, "ide2");
 
-  // Check if disk 1 is present
-  outb(0x1f6, 0xe0 | (1<<4));
-  for(i=0; i<1000; i++){
-    if(inb(0x1f7) != 0){
-      havedisk1 = 1;
-      break;
-    }
-  }
+  // Disk 0 holds the kernel, so the primary channel is there.
+  ch = &chans[0];
+  ioapicenable(ch->irq, ncpu - 1);
+  idewait(ch, 0);
+  ch->havedisk[0] = 1;
+  ch->havedisk[1] = ideprobe(ch, 1);
 
   // Switch back to disk 0.
-  outb(0x1f6, 0xe0 | (0<<4));
+  outb(ch->base+6, 0xe0 | (0<<4));
+
+  // The secondary channel is optional; don't touch it further
+  // (idewait would spin forever) unless its master answers.
+  ch = &chans[1];
+  if(ideprobe(ch, 0)){
+    ch->havedisk[0] = 1;
+    ioapicenable(ch->irq, ncpu - 1);
+    idewait(ch, 0);
+  }
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the disk command for b and the bufs chained to it,
+// which are for consecutive blocks.  Caller must hold ch->lock.
 static void
-idestart(struct buf *b)
+idestart(struct idechan *ch, struct buf *b)
 {
+  struct buf *p;
+  int n;
+
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE){
-    cprintf("incorrect blockno: %d\n", b->blockno);
-    panic("incorrect blockno");
+  n = 0;
+  for(p = b; p; p = p->bnext){
+    if(p->blockno >= FSSIZE){
+      cprintf("incorrect blockno: %d\n", p->blockno);
+      panic("incorrect blockno");
+    }
+    n++;
   }
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
   int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
   int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
-  if (sector_per_block > 7) panic("idestart");
+  if (sector_per_block > 7 || n*sector_per_block > 255) panic("idestart");
 
-  idewait(0);
-  outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
-  outb(0x1f3, sector & 0xff);
-  outb(0x1f4, (sector >> 8) & 0xff);
-  outb(0x1f5, (sector >> 16) & 0xff);
-  outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
+  idewait(ch, 0);
+  outb(ch->ctl, 0);  // generate interrupt
+  outb(ch->base+2, n*sector_per_block);  // number of sectors
+  outb(ch->base+3, sector & 0xff);
+  outb(ch->base+4, (sector >> 8) & 0xff);
+  outb(ch->base+5, (sector >> 16) & 0xff);
+  outb(ch->base+6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    outb(ch->base+7, write_cmd);
+    outsl(ch->base, b->data, BSIZE/4);
   } else {
-    outb(0x1f7, read_cmd);
+    outb(ch->base+7, read_cmd);
   }
 }
 
-// Interrupt handler.
-void
-ideintr(void)
+// Start the next command the scheduler picks, if any.
+// Caller must hold ch->lock.
+static void
+idenext(struct idechan *ch)
 {
   struct buf *b;
 
-  // First queued buffer is the active request.
-  acquire(&idelock);
+  b = ioq_next(&ch->q);
+  ch->active = ch->cur = b;
+  if(b != 0)
+    idestart(ch, b);
+}
+
+// Interrupt handler for channel c.  The disk interrupts once
+// per block of a multi-block command: for a read when the
+// block's data is ready, for a write when the block is written.
+void
+ideintr(int c)
+{
+  struct idechan *ch = &chans[c];
+  struct buf *b, *next;
+
+  acquire(&ch->lock);
 
-  if((b = idequeue) == 0){
-    release(&idelock);
+  if((b = ch->cur) == 0){
+    release(&ch->lock);
     return;
   }
-  idequeue = b->qnext;
 
   // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  if(!(b->flags & B_DIRTY) && idewait(ch, 1) >= 0)
+    insl(ch->base, b->data, BSIZE/4);
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  // More blocks in this command: feed the disk the next one.
+  if(b->bnext != 0){
+    ch->cur = b->bnext;
+    if(ch->cur->flags & B_DIRTY)
+      outsl(ch->base, ch->cur->data, BSIZE/4);
+    release(&ch->lock);
+    return;
+  }
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  // Command done: wake processes waiting for its bufs.
+  for(b = ch->active; b; b = next){
+    next = b->bnext;
+    b->bnext = 0;
+    ioq_done(&ch->q, b);
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+  }
 
-  release(&idelock);
+  // Start disk on next command.
+  idenext(ch);
+
+  release(&ch->lock);
 }
 
 //PAGEBREAK!
@@ -139,32 +219,48 @@ ideintr(void)
 void
 iderw(struct buf *b)
 {
-  struct buf **pp;
+  iderwv(&b, 1);
+}
+
+// Sync n bufs on one disk, queuing them all before waiting,
+// so that bufs for consecutive blocks go in one command.
+void
+iderwv(struct buf **bs, int n)
+{
+  struct idechan *ch;
+  struct buf *b;
+  int i;
 
-  if(!holdingsleep(&b->lock))
-    panic("iderw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+  for(i = 0; i < n; i++){
+    b = bs[i];
+    if(!holdingsleep(&b->lock))
+      panic("iderw: buf not locked");
+    if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("iderw: nothing to do");
+    if(b->dev != bs[0]->dev)
+      panic("iderw: several disks");
+  }
+  if(bs[0]->dev >= 2*NELEM(chans))
+    panic("iderw: no such ide disk");
+  ch = &chans[bs[0]->dev/2];
+  if(!ch->havedisk[bs[0]->dev&1]){
+    cprintf("iderw: ide disk %d not present\n", bs[0]->dev);
+    panic("iderw");
+  }
 
-  acquire(&idelock);  //DOC:acquire-lock
+  acquire(&ch->lock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
-    ;
-  *pp = b;
+  for(i = 0; i < n; i++)
+    ioq_add(&ch->q, bs[i]);  //DOC:insert-queue
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
-
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
-  }
+  if(ch->active == 0)
+    idenext(ch);
 
+  // Wait for requests to finish.
+  for(i = 0; i < n; i++)
+    while((bs[i]->flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(bs[i], &ch->lock);
 
-  release(&idelock);
+  release(&ch->lock);
 }
@@ -0,0 +1,77 @@
+// idlestat: how much each CPU halts, and how much locks spin.
+//   idlestat [-l nproc] [ticks]
+// Samples per-CPU statistics over ticks clock ticks (default
+// 100).  With -l, runs nproc CPU-bound children meanwhile.
+// An idle machine should show its CPUs halted nearly all the
+// time, with few halts: a halted CPU does not wake for ticks
+// it does not need.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pstat.h"
+
+struct cpustat before[NCPU], after[NCPU];
+
+void
+spin(void)
+{
+  volatile int i;
+
+  for(;;)
+    for(i = 0; i < 1000000; i++)
+      ;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, nproc, t, pct;
+  uint t0, ms;
+  int pids[NPROC];
+
+  nproc = 0;
+  t = 100;
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-l") == 0 && i+1 < argc)
+      nproc = atoi(argv[++i]);
+    else
+      t = atoi(argv[i]);
+  }
+  if(t <= 0 || nproc < 0 || nproc > NPROC/2){
+    printf(2, "usage: idlestat [-l nproc] [ticks]\n");
+    exit();
+  }
+
+  for(i = 0; i < nproc; i++){
+    if((pids[i] = fork()) < 0){
+      nproc = i;
+      break;
+    }
+    if(pids[i] == 0)
+      spin();
+  }
+
+  n = cpustat(before, NCPU);
+  t0 = usecs();
+  sleep(t);
+  ms = (usecs() - t0) / 1000;
+  cpustat(after, NCPU);
+
+  for(i = 0; i < nproc; i++)
+    kill(pids[i]);
+  for(i = 0; i < nproc; i++)
+    wait();
+
+  printf(1, "%d ms, %d busy processes\n", ms, nproc);
+  printf(1, "cpu\tidle%%\thalts\twakeups\tspins\n");
+  for(i = 0; i < n; i++){
+    pct = ms > 0 ? (after[i].idleus - before[i].idleus) / 1000 * 100 / ms : 0;
+    printf(1, "%d\t%d\t%d\t%d\t%d\n", after[i].cpu, pct,
+      after[i].nhalt - before[i].nhalt,
+      after[i].nwake - before[i].nwake,
+      after[i].nspin - before[i].nspin);
+  }
+  exit();
+}
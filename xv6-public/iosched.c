@@ -0,0 +1,241 @@
+// Block I/O scheduler.
+//
+// Disk drivers queue bufs with ioq_add() and ask ioq_next() for
+// the next disk command when the disk goes idle.  The policy of
+// each queue decides which waiting buf goes next:
+//
+// * noop: arrival order, as xv6 always did.
+// * clook: the nearest block at or after the disk head, wrapping
+//   around to the lowest block, which keeps the head sweeping in
+//   one direction.
+// * deadline (default): clook, but reads go before writes, since
+//   a process is usually blocked on a read (bread), while writes
+//   come in bulk from the log.  A read that has waited READEXPIRE
+//   ticks or a write that has waited WRITEEXPIRE goes next
+//   regardless, so neither can starve.
+//
+// Whatever the policy picks, waiting bufs for the following
+// blocks in the same direction ride along in one disk command
+// (chained through bnext), up to MAXMERGE blocks.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "iostat.h"
+#include "iosched.h"
+
+#define READEXPIRE   5
+#define WRITEEXPIRE 50
+
+static struct {
+  struct spinlock lock;
+  struct ioqueue *q[NIOQ];
+  int n;
+} ioqs;
+
+// Set up q, protected by lk, and make its statistics
+// visible to iostat under name.
+void
+ioq_init(struct ioqueue *q, struct spinlock *lk, char *name)
+{
+  static int first = 1;
+
+  if(first){
+    initlock(&ioqs.lock, "ioqs");
+    first = 0;
+  }
+  memset(q, 0, sizeof(*q));
+  q->lock = lk;
+  q->st.policy = IOSCHED_DEADLINE;
+  safestrcpy(q->st.name, name, sizeof(q->st.name));
+
+  acquire(&ioqs.lock);
+  if(ioqs.n >= NIOQ)
+    panic("ioq_init: too many queues");
+  ioqs.q[ioqs.n++] = q;
+  release(&ioqs.lock);
+}
+
+// Queue b.  Caller holds q->lock.
+void
+ioq_add(struct ioqueue *q, struct buf *b)
+{
+  struct buf **pp;
+
+  b->qnext = 0;
+  b->bnext = 0;
+  b->qtime = ticks;
+  b->qus = usecs();
+  for(pp=&q->pending; *pp; pp=&(*pp)->qnext)
+    ;
+  *pp = b;
+  if(++q->st.depth > q->st.maxdepth)
+    q->st.maxdepth = q->st.depth;
+}
+
+#define ISWRITE(b)  (((b)->flags & B_DIRTY) != 0)
+
+// Clook choice among waiting bufs whose direction is dir
+// (0 read, 1 write, -1 either).
+static struct buf*
+clook(struct ioqueue *q, int dir)
+{
+  struct buf *b, *ahead, *low;
+
+  ahead = low = 0;
+  for(b = q->pending; b; b = b->qnext){
+    if(dir >= 0 && ISWRITE(b) != dir)
+      continue;
+    if(b->blockno >= q->head && (ahead == 0 || b->blockno < ahead->blockno))
+      ahead = b;
+    if(low == 0 || b->blockno < low->blockno)
+      low = b;
+  }
+  return ahead ? ahead : low;
+}
+
+// Oldest waiting buf in direction dir, if it has
+// waited at least expire ticks.
+static struct buf*
+expired(struct ioqueue *q, int dir, uint expire)
+{
+  struct buf *b;
+
+  for(b = q->pending; b; b = b->qnext)
+    if(ISWRITE(b) == dir)
+      return ticks - b->qtime >= expire ? b : 0;
+  return 0;
+}
+
+static struct buf*
+pick(struct ioqueue *q)
+{
+  struct buf *b;
+
+  switch(q->st.policy){
+  case IOSCHED_CLOOK:
+    return clook(q, -1);
+  case IOSCHED_DEADLINE:
+    if((b = expired(q, 0, READEXPIRE)) != 0)
+      return b;
+    if((b = expired(q, 1, WRITEEXPIRE)) != 0)
+      return b;
+    if((b = clook(q, 0)) != 0)
+      return b;
+    return clook(q, 1);
+  default:
+    return q->pending;
+  }
+}
+
+static void
+unqueue(struct ioqueue *q, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp=&q->pending; *pp != b; pp=&(*pp)->qnext)
+    ;
+  *pp = b->qnext;
+  b->qnext = 0;
+  q->st.depth--;
+}
+
+// Choose the next disk command: returns its first buf, with
+// bufs for the following blocks chained through bnext.
+// Returns 0 if nothing is waiting.  Caller holds q->lock.
+struct buf*
+ioq_next(struct ioqueue *q)
+{
+  struct buf *first, *last, *b;
+  int n;
+
+  if(q->pending == 0)
+    return 0;
+  first = last = pick(q);
+  unqueue(q, first);
+  for(n = 1; n < MAXMERGE; n++){
+    for(b = q->pending; b; b = b->qnext)
+      if(b->dev == first->dev && ISWRITE(b) == ISWRITE(first) &&
+         b->blockno == last->blockno + 1)
+        break;
+    if(b == 0)
+      break;
+    unqueue(q, b);
+    last->bnext = b;
+    last = b;
+  }
+
+  q->st.nreq++;
+  q->st.nmerged += n - 1;
+  if(first->blockno > q->head)
+    q->st.seek += first->blockno - q->head;
+  else
+    q->st.seek += q->head - first->blockno;
+  q->head = last->blockno + 1;
+  return first;
+}
+
+// Account for completion of b.  Caller holds q->lock.
+void
+ioq_done(struct ioqueue *q, struct buf *b)
+{
+  uint lat;
+
+  lat = usecs() - b->qus;
+  if(ISWRITE(b)){
+    q->st.nwrite++;
+    q->st.wlat += lat;
+    if(lat > q->st.wmax)
+      q->st.wmax = lat;
+  } else {
+    q->st.nread++;
+    q->st.rlat += lat;
+    if(lat > q->st.rmax)
+      q->st.rmax = lat;
+  }
+}
+
+static struct ioqueue*
+getq(int n)
+{
+  struct ioqueue *q;
+
+  acquire(&ioqs.lock);
+  q = (n >= 0 && n < ioqs.n) ? ioqs.q[n] : 0;
+  release(&ioqs.lock);
+  return q;
+}
+
+// Copy out the statistics of queue n.
+int
+ioq_stat(int n, struct iostat *st)
+{
+  struct ioqueue *q;
+
+  if((q = getq(n)) == 0)
+    return -1;
+  acquire(q->lock);
+  *st = q->st;
+  release(q->lock);
+  return 0;
+}
+
+// Switch queue n to policy; returns the old policy.
+int
+ioq_setpolicy(int n, int policy)
+{
+  struct ioqueue *q;
+  int old;
+
+  if((q = getq(n)) == 0 || policy < IOSCHED_NOOP || policy > IOSCHED_DEADLINE)
+    return -1;
+  acquire(q->lock);
+  old = q->st.policy;
+  q->st.policy = policy;
+  release(q->lock);
+  return old;
+}
@@ -0,0 +1,13 @@
+// Block I/O scheduler: a request queue between the buffer
+// cache and a disk driver.  The driver owns the lock and holds
+// it around every ioq_ call.
+
+#define NIOQ      4   // maximum number of disk queues
+#define MAXMERGE  8   // most blocks in one disk command
+
+struct ioqueue {
+  struct spinlock *lock;   // driver's lock protecting this queue
+  struct buf *pending;     // waiting bufs in arrival order, via qnext
+  uint head;               // block after the last one transferred
+  struct iostat st;
+};
@@ -0,0 +1,50 @@
+// iostat: show disk queue statistics.
+// iostat -s noop|clook|deadline switches every queue's policy first.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "iostat.h"
+
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+char *policies[] = {
+[IOSCHED_NOOP]      "noop",
+[IOSCHED_CLOOK]     "clook",
+[IOSCHED_DEADLINE]  "deadline",
+};
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat st;
+  int i, p;
+
+  if(argc == 3 && strcmp(argv[1], "-s") == 0){
+    for(p = 0; p < NELEM(policies); p++)
+      if(strcmp(argv[2], policies[p]) == 0)
+        break;
+    if(p == NELEM(policies)){
+      printf(2, "iostat: unknown policy %s\n", argv[2]);
+      exit();
+    }
+    for(i = 0; iosched(i, p) >= 0; i++)
+      ;
+  } else if(argc != 1){
+    printf(2, "usage: iostat [-s noop|clook|deadline]\n");
+    exit();
+  }
+
+  for(i = 0; iostat(i, &st) == 0; i++){
+    printf(1, "%s: %s, %d waiting (max %d)\n", st.name, policies[st.policy],
+      st.depth, st.maxdepth);
+    printf(1, "  %d reads, %d writes, %d commands, %d merged, seek %d\n",
+      st.nread, st.nwrite, st.nreq, st.nmerged, st.seek);
+    printf(1, "  read latency avg %d max %d, write latency avg %d max %d (us)\n",
+      st.nread ? st.rlat/st.nread : 0, st.rmax,
+      st.nwrite ? st.wlat/st.nwrite : 0, st.wmax);
+  }
+  if(i == 0)
+    printf(1, "iostat: no disk queues\n");
+  exit();
+}
@@ -0,0 +1,23 @@
+// Disk queue statistics, as returned by the iostat system call.
+// Both the kernel and user programs use this header file.
+
+// I/O scheduling policies (iosched system call).
+#define IOSCHED_NOOP      0   // arrival order
+#define IOSCHED_CLOOK     1   // elevator, one sweep direction
+#define IOSCHED_DEADLINE  2   // C-LOOK, reads first, expiry for both
+
+struct iostat {
+  char name[8];     // queue name
+  int policy;       // IOSCHED_*
+  uint nread;       // blocks read
+  uint nwrite;      // blocks written
+  uint nreq;        // disk commands issued
+  uint nmerged;     // blocks merged into another block's command
+  uint rlat;        // total read latency (us, queued to done)
+  uint wlat;        // total write latency
+  uint rmax;        // worst read latency
+  uint wmax;        // worst write latency
+  uint seek;        // total head movement (blocks)
+  uint depth;       // requests waiting now
+  uint maxdepth;    // most requests ever waiting
+};
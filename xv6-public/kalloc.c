@@ -1,6 +1,7 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and blocks of
+// 2^order physically contiguous pages with kalloc_pages.
 
 #include "types.h"
 #include "defs.h"
@@ -8,6 +9,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "pstat.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -15,12 +17,56 @@ extern char end[]; // first address after kernel loaded from ELF file
 
 struct run {
   struct run *next;
+  struct run *prev;  // on the buddy lists only
 };
 
+// Free memory is kept by a buddy allocator: freelist[k] holds
+// free blocks of 2^k pages, each aligned to its size.  A block
+// of order k is split into two buddies of order k-1 to satisfy
+// a smaller request; a freed block whose buddy is free too is
+// merged with it into a block of order k+1, and so on up.
+// order[] marks the first page of each free block with the
+// block's order plus one, and every other page with 0.
+#define PFN(v)  (V2P(v)/PGSIZE)
+#define PAGE(n) ((struct run*)P2V((n)*PGSIZE))
+
+// Free pages are also kept, outside the buddy allocator, on
+// two kinds of list: DIRTY pages, as they were freed, and
+// ZEROED ones, which idle CPUs fill with zeros ahead of time
+// (see kzero) for kalloc_zeroed.
+#define DIRTY  0
+#define ZEROED 1
+
+// Single pages are freed to, and allocated from, a cache on
+// the current CPU.  A cache that runs empty takes KBATCH pages
+// from the buddy allocator at once, and one that grows past
+// 2*KBATCH gives KBATCH back, so CPUs rarely contend for
+// kmem.lock.  Before kinit2, with one CPU running, everything
+// goes to the buddy allocator.
+#define KBATCH 32
+
+struct kcache {
+  struct spinlock lock;
+  struct run *list[2];
+  int n[2];
+};
+
+// ref counts the users of each physical page, so that
+// copy-on-write fork can share pages: kalloc returns a page
+// with one reference, kref adds one, and kfree drops one,
+// freeing the page when the last is gone.  Counts change
+// with atomic instructions, outside any lock.
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run *freelist[MAXORDER+1];
+  uint nfree[MAXORDER+1];   // blocks on freelist[k]
+  struct run *zeroed;       // ZEROED pages not yet on a CPU
+  int nzeroed;
+  uint npage;               // pages given to the allocator
+  struct kcache cpu[NCPU];
+  uchar order[PHYSTOP/PGSIZE];
+  ushort ref[PHYSTOP/PGSIZE];
 } kmem;
 
 // Initialization happens in two phases.
@@ -31,7 +77,11 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cpu[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -48,49 +98,422 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    kmem.ref[PFN(p)] = 1;
+    kmem.npage++;
     kfree(p);
+  }
+}
+
+//PAGEBREAK!
+// The buddy allocator.  Caller must hold kmem.lock.
+
+static void
+bpush(struct run *r, int k)
+{
+  r->prev = 0;
+  r->next = kmem.freelist[k];
+  if(r->next)
+    r->next->prev = r;
+  kmem.freelist[k] = r;
+  kmem.nfree[k]++;
+  kmem.order[PFN(r)] = k + 1;
+}
+
+static void
+bremove(struct run *r, int k)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist[k] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nfree[k]--;
+  kmem.order[PFN(r)] = 0;
+}
+
+// Allocate a block of 2^order pages, or return 0.
+static struct run*
+balloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER && kmem.freelist[k] == 0; k++)
+    ;
+  if(k > MAXORDER)
+    return 0;
+  r = kmem.freelist[k];
+  bremove(r, k);
+  // Give back the upper halves until the block fits.
+  while(k > order){
+    k--;
+    bpush(PAGE(PFN(r) + (1 << k)), k);
+  }
+  return r;
+}
+
+// Free the block of 2^order pages at r, merging it with
+// its buddy as long as that is free too.
+static void
+bfree(struct run *r, int order)
+{
+  uint n, b;
+
+  n = PFN(r);
+  for(; order < MAXORDER; order++){
+    b = n ^ (1 << order);
+    if(b >= PHYSTOP/PGSIZE || kmem.order[b] != order + 1)
+      break;
+    bremove(PAGE(b), order);
+    n &= ~(1 << order);
+  }
+  bpush(PAGE(n), order);
+}
+
+//PAGEBREAK!
+// Lock and return the current CPU's cache.  The process may
+// move to another CPU right after; it then just uses that
+// CPU's cache from afar.
+static struct kcache*
+mycache(void)
+{
+  struct kcache *kc;
+
+  pushcli();
+  kc = &kmem.cpu[cpuid()];
+  acquire(&kc->lock);
+  popcli();
+  return kc;
+}
+
+// Pop a page from list z of kc.  Caller must hold kc->lock.
+static struct run*
+kpop(struct kcache *kc, int z)
+{
+  struct run *r;
+
+  if((r = kc->list[z]) != 0){
+    kc->list[z] = r->next;
+    kc->n[z]--;
+  }
+  return r;
+}
+
+// Give every page in the CPU caches and the zeroed pool back
+// to the buddy allocator, so that they can merge into larger
+// blocks.
+static void
+kdrain(void)
+{
+  struct kcache *kc;
+  struct run *r;
+  int z;
+
+  for(kc = kmem.cpu; kc < &kmem.cpu[NCPU]; kc++){
+    acquire(&kc->lock);
+    acquire(&kmem.lock);
+    for(z = DIRTY; z <= ZEROED; z++)
+      while((r = kpop(kc, z)) != 0)
+        bfree(r, 0);
+    release(&kmem.lock);
+    release(&kc->lock);
+  }
+  acquire(&kmem.lock);
+  while((r = kmem.zeroed) != 0){
+    kmem.zeroed = r->next;
+    kmem.nzeroed--;
+    bfree(r, 0);
+  }
+  release(&kmem.lock);
 }
+
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last one.
+// (The exception is when initializing the allocator; see
+// kinit above.)
 void
 kfree(char *v)
 {
   struct run *r;
+  struct kcache *kc;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  switch(__sync_fetch_and_sub(&kmem.ref[PFN(v)], 1)){
+  case 0:
+    panic("kfree: free page");
+  case 1:
+    break;
+  default:
+    return;
+  }
+
+#ifdef MEMDEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
+  if(!kmem.use_lock){
+    bfree(r, 0);
+    return;
+  }
+  kc = mycache();
+  r->next = kc->list[DIRTY];
+  kc->list[DIRTY] = r;
+  if(++kc->n[DIRTY] > 2*KBATCH){
+    acquire(&kmem.lock);
+    while(kc->n[DIRTY] > KBATCH)
+      bfree(kpop(kc, DIRTY), 0);
     release(&kmem.lock);
+  }
+  release(&kc->lock);
+}
+
+// Take a page from list z of the current CPU's cache,
+// refilling it if empty: DIRTY pages from the buddy
+// allocator, ZEROED ones from the zeroed pool.
+static struct run*
+kget(int z)
+{
+  struct kcache *kc;
+  struct run *r;
+  int refilled;
+
+  kc = mycache();
+  refilled = 0;
+  if(kc->list[z] == 0){
+    refilled = 1;
+    acquire(&kmem.lock);
+    while(kc->n[z] < KBATCH){
+      if(z == DIRTY)
+        r = balloc(0);
+      else if((r = kmem.zeroed) != 0){
+        kmem.zeroed = r->next;
+        kmem.nzeroed--;
+      }
+      if(r == 0)
+        break;
+      r->next = kc->list[z];
+      kc->list[z] = r;
+      kc->n[z]++;
+    }
+    release(&kmem.lock);
+  }
+  r = kpop(kc, z);
+  release(&kc->lock);
+  // Refills are rare enough to look at free memory each time.
+  if(refilled && kfreepages() < SWAPLOW)
+    swapkick();
+  return r;
+}
+
+// Take a page from any CPU's cache.
+static struct run*
+ksteal(void)
+{
+  struct kcache *kc;
+  struct run *r;
+  int z;
+
+  r = 0;
+  for(kc = kmem.cpu; kc < &kmem.cpu[NCPU] && r == 0; kc++){
+    acquire(&kc->lock);
+    for(z = DIRTY; z <= ZEROED && r == 0; z++)
+      r = kpop(kc, z);
+    release(&kc->lock);
+  }
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
-// Returns 0 if the memory cannot be allocated.
+// Returns 0 if the memory cannot be allocated, even after
+// taking back the page cache's unused pages and, if the
+// caller holds no spinlock, waiting for kswapd to page out.
 char*
 kalloc(void)
 {
   struct run *r;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
+  if(!kmem.use_lock)
+    r = balloc(0);
+  else {
+    for(;;){
+      if((r = kget(DIRTY)) != 0 || (r = kget(ZEROED)) != 0 ||
+         (r = ksteal()) != 0)
+        break;
+      if(pcshrink() == 0 && !swapwait())
+        break;
+    }
+  }
   if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+    kmem.ref[PFN(r)] = 1;
+  return (char*)r;
+}
+
+// Allocate a page filled with zeros, preferably one zeroed
+// ahead of time.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+  char *mem;
+
+  if(kmem.use_lock && (r = kget(ZEROED)) != 0){
+    kmem.ref[PFN(r)] = 1;
+    r->next = 0;  // the only words the free lists wrote
+    r->prev = 0;
+    return (char*)r;
+  }
+  if((mem = kalloc()) != 0)
+    memset(mem, 0, PGSIZE);
+  return mem;
+}
+
+static struct run*
+kallocb(int order)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  r = balloc(order);
+  release(&kmem.lock);
+  return r;
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size.  Free them with kfree_pages, not kfree: the
+// block has a single reference, on its first page.
+// Returns 0 if the memory cannot be allocated, even after
+// draining the CPU caches and the page cache.
+char*
+kalloc_pages(int order)
+{
+  struct run *r;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+  if(order == 0)
+    return kalloc();
+  if((r = kallocb(order)) == 0){
+    kdrain();
+    if((r = kallocb(order)) == 0 && pcshrink() > 0){
+      kdrain();
+      r = kallocb(order);
+    }
+  }
+  if(r)
+    kmem.ref[PFN(r)] = 1;
   return (char*)r;
 }
 
+// Free a block from kalloc_pages(order).
+void
+kfree_pages(char *v, int order)
+{
+  if(order == 0){
+    kfree(v);
+    return;
+  }
+  if(order < 0 || order > MAXORDER ||
+     (uint)v % (PGSIZE << order) || v < end || V2P(v) >= PHYSTOP)
+    panic("kfree_pages");
+  if(__sync_fetch_and_sub(&kmem.ref[PFN(v)], 1) != 1)
+    panic("kfree_pages: shared");
+#ifdef MEMDEBUG
+  memset(v, 1, PGSIZE << order);
+#endif
+  acquire(&kmem.lock);
+  bfree((struct run*)v, order);
+  release(&kmem.lock);
+}
+
+// Zero a free page for kalloc_zeroed, if fewer than NZEROED
+// are ready.  Called by the scheduler of a CPU with nothing
+// else to do.  Returns 1 if it zeroed a page, 0 if not.
+int
+kzero(void)
+{
+  struct run *r;
+
+  if(!kmem.use_lock)
+    return 0;
+  acquire(&kmem.lock);
+  if(kmem.nzeroed >= NZEROED || (r = balloc(0)) == 0){
+    release(&kmem.lock);
+    return 0;
+  }
+  release(&kmem.lock);
+
+  memset(r, 0, PGSIZE);
+
+  acquire(&kmem.lock);
+  r->next = kmem.zeroed;
+  kmem.zeroed = r;
+  kmem.nzeroed++;
+  release(&kmem.lock);
+  return 1;
+}
+
+// Add a reference to the allocated page at v.
+void
+kref(char *v)
+{
+  if(__sync_fetch_and_add(&kmem.ref[PFN(v)], 1) == 0)
+    panic("kref");
+}
+
+// Number of references to the page at v.
+int
+krefs(char *v)
+{
+  return kmem.ref[PFN(v)];
+}
+
+// Roughly how many pages are free, counted without locks.
+uint
+kfreepages(void)
+{
+  struct kcache *kc;
+  uint n;
+  int k;
+
+  n = kmem.nzeroed;
+  for(k = 0; k <= MAXORDER; k++)
+    n += kmem.nfree[k] << k;
+  for(kc = kmem.cpu; kc < &kmem.cpu[NCPU]; kc++)
+    n += kc->n[DIRTY] + kc->n[ZEROED];
+  return n;
+}
+
+// Fill in *mi with the state of free memory.
+void
+getmeminfo(struct meminfo *mi)
+{
+  struct kcache *kc;
+  int k;
+
+  memset(mi, 0, sizeof(*mi));
+  mi->npage = kmem.npage;
+  for(kc = kmem.cpu; kc < &kmem.cpu[NCPU]; kc++){
+    acquire(&kc->lock);
+    mi->ncached += kc->n[DIRTY] + kc->n[ZEROED];
+    mi->nzeroed += kc->n[ZEROED];
+    release(&kc->lock);
+  }
+  acquire(&kmem.lock);
+  mi->nzeroed += kmem.nzeroed;
+  mi->nfree += kmem.nzeroed;
+  for(k = 0; k <= MAXORDER; k++){
+    mi->nblock[k] = kmem.nfree[k];
+    mi->nfree += kmem.nfree[k] << k;
+  }
+  release(&kmem.lock);
+  mi->nfree += mi->ncached;
+}
@@ -43,6 +43,8 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+static uint tickcount;  // timer counts per tick, calibrated at boot
+
 //PAGEBREAK!
 static void
 lapicw(int index, int value)
@@ -62,11 +64,17 @@ lapicinit(void)
 
   // The timer repeatedly counts down at bus frequency
   // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The first CPU here measures the bus frequency against
+  // the PIT, so that a tick is 1/HZ seconds.
   lapicw(TDCR, X1);
+  if(tickcount == 0){
+    lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, 0xFFFFFFFF);
+    pitwait(1000/HZ);
+    tickcount = 0xFFFFFFFF - lapic[TCCR];
+  }
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TICR, tickcount);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -113,6 +121,60 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// An idle CPU needs no periodic tick.  Make this CPU's timer
+// interrupt once, n ticks from now, or not at all if n is 0.
+void
+lapiconeshot(uint n)
+{
+  if(!lapic)
+    return;
+  if(n == 0){
+    lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+    return;
+  }
+  if(n > 0xFFFFFFFF / tickcount)
+    n = 0xFFFFFFFF / tickcount;
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);  // one-shot mode
+  lapicw(TICR, n * tickcount);
+}
+
+// Go back to periodic ticks after lapiconeshot(n).
+// Returns the number of whole ticks that passed meanwhile
+// without a timer interrupt to count them.
+uint
+lapicperiodic(uint n)
+{
+  uint left, passed;
+
+  if(!lapic)
+    return 0;
+  if(n > 0xFFFFFFFF / tickcount)
+    n = 0xFFFFFFFF / tickcount;
+  passed = 0;
+  if(n > 0){
+    left = lapic[TCCR];
+    if(left == 0)
+      passed = n - 1;  // it fired, and the interrupt counted one
+    else
+      passed = (n * tickcount - left) / tickcount;
+  }
+  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, tickcount);
+  return passed;
+}
+
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
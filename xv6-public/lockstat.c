@@ -0,0 +1,219 @@
+// Lock contention statistics, kept by kernels built with
+// make LOCKSTAT=1 and readable from the lockstat device:
+//   cat lockstat
+// Statistics are kept per lock name, so that, say, all the
+// pipe locks add up in one entry.  Locks sharing a name update
+// it without a lock of their own, so counts can be slightly
+// off when several of them are busy at once.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#ifdef LOCKSTAT
+
+#define NLOCKSTAT 32
+
+static struct lockstat stats[NLOCKSTAT];
+static struct lockstat other = { "other" };  // once stats[] is full
+static uint statbusy;  // guards naming stats[]; a spinlock would recurse
+
+// Point lk at the statistics for its name.
+void
+lsinit(struct spinlock *lk)
+{
+  struct lockstat *s;
+
+  while(xchg(&statbusy, 1) != 0)
+    ;
+  for(s = stats; s < &stats[NLOCKSTAT] && s->name; s++)
+    if(strncmp(s->name, lk->name, 16) == 0)
+      break;
+  if(s == &stats[NLOCKSTAT])
+    s = &other;
+  else if(s->name == 0)
+    s->name = lk->name;
+  s->ninit++;
+  lk->stat = s;
+  xchg(&statbusy, 0);
+}
+
+// Count a contended acquisition from pc.  The callers
+// array keeps the most frequent ones: a new caller replaces
+// the least frequent, taking over its count.
+static void
+lscaller(struct lockstat *s, uint pc)
+{
+  int i, min;
+
+  min = 0;
+  for(i = 0; i < NLOCKCALLER; i++){
+    if(s->caller[i].pc == pc){
+      s->caller[i].n++;
+      return;
+    }
+    if(s->caller[i].n < s->caller[min].n)
+      min = i;
+  }
+  s->caller[min].pc = pc;
+  s->caller[min].n++;
+}
+
+// lk has just been acquired by pc, after spins spins.
+void
+lsacquired(struct spinlock *lk, uint spins, uint pc)
+{
+  struct lockstat *s = lk->stat;
+
+  lk->tacquire = rdtsc();
+  s->nacquire++;
+  if(spins > 0){
+    s->ncontend++;
+    s->nspin += spins;
+    lscaller(s, pc);
+  }
+}
+
+// lk is about to be released.
+void
+lsreleased(struct spinlock *lk)
+{
+  struct lockstat *s = lk->stat;
+  uint64 d;
+
+  d = rdtsc() - lk->tacquire;
+  s->hold += d;
+  if(d > 0xFFFFFFFF)
+    d = 0xFFFFFFFF;
+  if(d > s->maxhold)
+    s->maxhold = d;
+}
+
+//PAGEBREAK!
+// Formatting into a buffer.
+struct out {
+  char *p;
+  char *e;
+};
+
+static void
+outs(struct out *o, char *s)
+{
+  while(*s && o->p < o->e)
+    *o->p++ = *s++;
+}
+
+static void
+outn(struct out *o, uint64 x, int base)
+{
+  char tmp[24];
+  uint d;
+  int i;
+
+  i = 0;
+  do {
+    x = div64(x, base, &d);
+    tmp[i++] = "0123456789abcdef"[d];
+  } while(x != 0);
+  while(i > 0 && o->p < o->e)
+    *o->p++ = tmp[--i];
+}
+
+static void
+outline(struct out *o, struct lockstat *s, uint mhz)
+{
+  int i;
+
+  outs(o, s->name);
+  outs(o, "\t");
+  outn(o, s->ninit, 10);
+  outs(o, "\t");
+  outn(o, s->nacquire, 10);
+  outs(o, "\t");
+  outn(o, s->ncontend, 10);
+  outs(o, "\t");
+  outn(o, s->nspin, 10);
+  outs(o, "\t");
+  outn(o, div64(s->hold, mhz, 0), 10);
+  outs(o, "\t");
+  outn(o, div64(div64(s->hold, s->nacquire, 0) * 1000, mhz, 0), 10);
+  outs(o, "\t");
+  outn(o, div64((uint64)s->maxhold * 1000, mhz, 0), 10);
+  outs(o, "\n");
+  if(s->ncontend == 0)
+    return;
+  outs(o, "\tcallers:");
+  for(i = 0; i < NLOCKCALLER && s->caller[i].n > 0; i++){
+    outs(o, " 0x");
+    outn(o, s->caller[i].pc, 16);
+    outs(o, "(");
+    outn(o, s->caller[i].n, 10);
+    outs(o, ")");
+  }
+  outs(o, "\n");
+}
+
+// Write the statistics of every lock acquired so far to buf.
+// Returns the length.
+static int
+lsreport(char *buf, int n)
+{
+  struct out o;
+  struct lockstat *s;
+  uint mhz;
+
+  o.p = buf;
+  o.e = buf + n;
+  mhz = tsckhz / 1000;
+  if(mhz == 0)
+    mhz = 1;
+  outs(&o, "name\tinits\tacquire\tcontend\tspins\thold-us\tavg-ns\tmax-ns\n");
+  for(s = stats; s < &stats[NLOCKSTAT] && s->name; s++)
+    if(s->nacquire > 0)
+      outline(&o, s, mhz);
+  if(other.nacquire > 0)
+    outline(&o, &other, mhz);
+  return o.p - buf;
+}
+
+// Read the report, freshly made, from offset off.
+static int
+lockstatread(struct inode *ip, char *dst, uint off, int n)
+{
+  char *page;
+  int len;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  len = lsreport(page, PGSIZE);
+  if(off >= len)
+    n = 0;
+  else if(off + n > len)
+    n = len - off;
+  memmove(dst, page + off, n);
+  kfree(page);
+  return n;
+}
+
+void
+lockstatinit(void)
+{
+  devsw[LOCKSTATDEV].read = lockstatread;
+}
+
+#else
+
+// Without LOCKSTAT there are no statistics, and the lockstat
+// device has no driver: reading it fails.
+void
+lockstatinit(void)
+{
+}
+
+#endif
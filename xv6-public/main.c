@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 
@@ -21,15 +22,22 @@ main(void)
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
+  timerinit();     // calibrate the clock
   seginit();       // segment descriptors
   picinit();       // disable pic
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
+  lockstatinit();  // lock statistics device
   uartinit();      // serial port
   pinit();         // process table
+  futexinit();     // user-space sleep queues
   tvinit();        // trap vectors
+  slabinit();      // object caches
   binit();         // buffer cache
+  pcacheinit();    // page cache
   fileinit();      // file table
+  pipeinit();      // pipes
+  shminit();       // shared memory segments
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
@@ -0,0 +1,46 @@
+// meminfo: free memory and its fragmentation.
+//   meminfo
+// Prints how much memory is free, how much of it the CPUs
+// hold in their caches, how much swap is in use, and the
+// buddy allocator's free blocks
+// of each order.  For each order k the last column is the
+// percentage of free memory in blocks too small for a
+// 2^k-page allocation: 0 means none of it is fragmented.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pstat.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo mi;
+  uint below, single, k;
+
+  if(meminfo(&mi) < 0){
+    printf(2, "meminfo: failed\n");
+    exit();
+  }
+  printf(1, "pages %d, free %d (%d KB), cached on CPUs %d, zeroed %d\n",
+    mi.npage, mi.nfree, mi.nfree * 4, mi.ncached, mi.nzeroed);
+  printf(1, "swap %d pages, used %d, paged out %d, in %d\n",
+    mi.nswap, mi.nswapped, mi.npageout, mi.npagein);
+  printf(1, "order\tblocks\tpages\tunusable%%\n");
+  // Free pages outside the buddy allocator's blocks, cached on
+  // CPUs or zeroed ahead of time, are single pages, as unusable
+  // for larger blocks as order 0 ones.
+  single = mi.nfree;
+  for(k = 0; k <= MAXORDER; k++)
+    single -= mi.nblock[k] << k;
+  below = 0;
+  for(k = 0; k <= MAXORDER; k++){
+    printf(1, "%d\t%d\t%d\t%d\n", k, mi.nblock[k], mi.nblock[k] << k,
+      mi.nfree ? below * 100 / mi.nfree : 0);
+    below += mi.nblock[k] << k;
+    if(k == 0)
+      below += single;
+  }
+  exit();
+}
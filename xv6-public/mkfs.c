@@ -11,18 +11,28 @@
 #include "stat.h"
 #include "param.h"
 
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
 #ifndef static_assert
 #define static_assert(a, b) do { switch (0) case 0: case (a): ; } while (0)
 #endif
 
-#define NINODES 200
+#define IPG 32  // inodes per block group
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | swap | group 0 | group 1 | ... ]
+// with each group of BPB blocks laid out as
+// [ free bit map | inode blocks | data blocks ]
+//
+// With -l log.img the log goes to its own image (attached as
+// LOGDEV), with -r to the kernel's ram disk; either way it is
+// left out of fs.img.
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
 int nlog = LOGSIZE;
+uint logdev;  // 0: log inside fs.img
+int nfslog;   // Number of log blocks inside fs.img
+int nswapb;   // Number of swap blocks
+int ngroups;  // Number of block groups
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -33,13 +43,15 @@ uint freeinode = 1;
 uint freeblock;
 
 
-void balloc(int);
+uint balloc(void);
+void wbitmaps(void);
 void wsect(uint, void*);
 void winode(uint, struct dinode*);
 void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void mklog(char *path);
 
 // convert to intel byte order
 ushort
@@ -67,7 +79,8 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, cc, fd, first, gsize, end;
+  char *logimg = 0;
   uint rootino, inum, off;
   struct dirent de;
   char buf[BSIZE];
@@ -77,10 +90,22 @@ main(int argc, char *argv[])
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs fs.img [-l log.img | -r] files...\n");
     exit(1);
   }
 
+  for(first = 2; first < argc && argv[first][0] == '-'; first++){
+    if(strcmp(argv[first], "-l") == 0 && first+1 < argc){
+      logimg = argv[++first];
+      logdev = LOGDEV;
+    } else if(strcmp(argv[first], "-r") == 0){
+      logdev = RAMDEV;
+    } else {
+      fprintf(stderr, "mkfs: unknown option %s\n", argv[first]);
+      exit(1);
+    }
+  }
+
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
@@ -90,22 +115,43 @@ main(int argc, char *argv[])
     exit(1);
   }
 
-  // 1 fs block = 1 disk sector
-  nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  if(logdev == RAMDEV)
+    assert(nlog+1 <= RAMDISKSIZE);
 
-  sb.size = xint(FSSIZE);
+  // 1 fs block = 1 disk sector
+  // An external log takes no room in fs.img.
+  nfslog = logdev ? 0 : nlog;
+  nswapb = NSWAP * BPP;
+  // A short last group is dropped unless it has room for data.
+  gsize = 1 + IPG/IPB;
+  ngroups = (FSSIZE - 2 - nfslog - nswapb) / BPB;
+  if((FSSIZE - 2 - nfslog - nswapb) % BPB > gsize)
+    ngroups++;
+  end = min(FSSIZE, 2 + nfslog + nswapb + ngroups*BPB);
+  nmeta = 2 + nfslog + nswapb + ngroups*gsize;
+  nblocks = end - nmeta;
+  assert(IPG % IPB == 0);
+  assert(ngroups*IPG <= 65536);  // dirent inum is a ushort
+
+  sb.size = xint(end);
   sb.nblocks = xint(nblocks);
-  sb.ninodes = xint(NINODES);
+  sb.ninodes = xint(ngroups*IPG);
   sb.nlog = xint(nlog);
-  sb.logstart = xint(2);
-  sb.inodestart = xint(2+nlog);
-  sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.logstart = xint(logdev ? 0 : 2);
+  sb.groupstart = xint(2+nfslog+nswapb);
+  sb.ngroups = xint(ngroups);
+  sb.ipg = xint(IPG);
+  sb.logdev = xint(logdev);
+  sb.swapstart = xint(2+nfslog);
+  sb.nswap = xint(NSWAP);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u, swap blocks %u, %d groups of %d inode blocks and a bitmap block) blocks %d total %d logdev %d\n",
+         nmeta, nfslog, nswapb, ngroups, (int)(IPG/IPB), nblocks, FSSIZE, logdev);
 
-  freeblock = nmeta;     // the first free block that we can allocate
+  if(logimg)
+    mklog(logimg);
+
+  freeblock = GDATA(0, sb);     // the first free block that we can allocate
 
   for(i = 0; i < FSSIZE; i++)
     wsect(i, zeroes);
@@ -127,7 +173,7 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
-  for(i = 2; i < argc; i++){
+  for(i = first; i < argc; i++){
     assert(index(argv[i], '/') == 0);
 
     if((fd = open(argv[i], 0)) < 0){
@@ -162,11 +208,32 @@ main(int argc, char *argv[])
   din.size = xint(off);
   winode(rootino, &din);
 
-  balloc(freeblock);
+  wbitmaps();
 
   exit(0);
 }
 
+// Create an empty external log: a zeroed header block
+// followed by nlog log blocks.
+void
+mklog(char *path)
+{
+  int i, fd;
+
+  fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0666);
+  if(fd < 0){
+    perror(path);
+    exit(1);
+  }
+  for(i = 0; i < nlog+1; i++){
+    if(write(fd, zeroes, BSIZE) != BSIZE){
+      perror("write");
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
 void
 wsect(uint sec, void *buf)
 {
@@ -234,24 +301,39 @@ ialloc(ushort type)
   return inum;
 }
 
+// Allocate the next data block, skipping group headers.
+// All files are packed from the start of group 0.
+uint
+balloc(void)
+{
+  if(freeblock == GSTART(BGROUP(freeblock, sb), sb))
+    freeblock = GDATA(BGROUP(freeblock, sb), sb);
+  assert(freeblock < sb.size);
+  return freeblock++;
+}
+
+// Write each group's free map: its own header blocks
+// and the blocks balloc handed out are in use, and so
+// are bits past the end of a short last group.
 void
-balloc(int used)
+wbitmaps(void)
 {
   uchar buf[BSIZE];
-  int i;
-
-  printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  int g, i;
+  uint b;
+
+  printf("balloc: first %d blocks have been allocated\n", freeblock);
+  for(g = 0; g < ngroups; g++){
+    bzero(buf, BSIZE);
+    for(i = 0; i < BPB; i++){
+      b = GSTART(g, sb) + i;
+      if(b < GDATA(g, sb) || b < freeblock || b >= sb.size)
+        buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    }
+    wsect(GSTART(g, sb), buf);
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
 }
 
-#define min(a, b) ((a) < (b) ? (a) : (b))
-
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -270,16 +352,16 @@ iappend(uint inum, void *xp, int n)
     assert(fbn < MAXFILE);
     if(fbn < NDIRECT){
       if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
+        din.addrs[fbn] = xint(balloc());
       }
       x = xint(din.addrs[fbn]);
     } else {
       if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
+        din.addrs[NDIRECT] = xint(balloc());
       }
       rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
+        indirect[fbn - NDIRECT] = xint(balloc());
         wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
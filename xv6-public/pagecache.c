@@ -0,0 +1,156 @@
+// Page cache: pages of program files, for exec's demand paging.
+// A cached page holds PGSIZE bytes of an inode's content from
+// some offset, and a reference of its own (see kalloc), so
+// processes running the same program share the page until one
+// writes it.  A page stays cached after its last user exits,
+// so the next run of the program finds it, until:
+//   * the inode's content changes (writei, itrunc),
+//   * its icache entry is recycled or freed (iget, iput),
+//   * kalloc runs out of memory and takes unused pages back,
+//   * the cache is full and it is the least recently used
+//     page nobody maps.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct cpage {
+  struct inode *ip;  // 0 if the entry is free
+  uint off;
+  char *page;
+  uint used;         // pcache.clock when last looked up
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage page[NPCACHE];
+  uint clock;
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+static struct cpage*
+pclookup(struct inode *ip, uint off)
+{
+  struct cpage *c;
+
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++)
+    if(c->ip == ip && c->off == off)
+      return c;
+  return 0;
+}
+
+static void
+pcdrop(struct cpage *c)
+{
+  c->ip->npcache--;
+  c->ip = 0;
+  kfree(c->page);
+}
+
+// Return a page holding ip's content from off, zero past the
+// end of the file, with a reference for the caller.  Caches
+// the page if there is room.  Returns 0 if out of memory.
+// Reads the inode, so it must be called without spinlocks
+// held and with ip unlocked.
+char*
+pcget(struct inode *ip, uint off)
+{
+  struct cpage *c, *victim;
+  char *mem;
+
+  acquire(&pcache.lock);
+  if((c = pclookup(ip, off)) != 0){
+    c->used = ++pcache.clock;
+    kref(c->page);
+    release(&pcache.lock);
+    return c->page;
+  }
+  release(&pcache.lock);
+
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  // Holding ip's lock from reading to caching keeps writei
+  // from changing the content in between (see pcinval).
+  ilock(ip);
+  readi(ip, mem, off, PGSIZE);
+
+  acquire(&pcache.lock);
+  if((c = pclookup(ip, off)) != 0){
+    // Another process read it first.
+    c->used = ++pcache.clock;
+    kref(c->page);
+    release(&pcache.lock);
+    iunlock(ip);
+    kfree(mem);
+    return c->page;
+  }
+  victim = 0;
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->ip == 0){
+      victim = c;
+      break;
+    }
+    if(krefs(c->page) == 1 && (victim == 0 || c->used < victim->used))
+      victim = c;
+  }
+  if(victim){
+    if(victim->ip)
+      pcdrop(victim);
+    victim->ip = ip;
+    victim->off = off;
+    victim->page = mem;
+    victim->used = ++pcache.clock;
+    ip->npcache++;
+    kref(mem);
+  }
+  release(&pcache.lock);
+  iunlock(ip);
+  return mem;
+}
+
+// Forget ip's cached pages.  Processes mapping them keep
+// them, with the old content.  Caller must hold ip's lock,
+// or have the only reference to it.
+void
+pcinval(struct inode *ip)
+{
+  struct cpage *c;
+
+  if(ip->npcache == 0)
+    return;
+  acquire(&pcache.lock);
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++)
+    if(c->ip == ip)
+      pcdrop(c);
+  release(&pcache.lock);
+}
+
+// Free the cached pages that no process maps, for kalloc.
+// Returns the number freed.
+int
+pcshrink(void)
+{
+  struct cpage *c;
+  int n;
+
+  n = 0;
+  acquire(&pcache.lock);
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->ip && krefs(c->page) == 1){
+      pcdrop(c);
+      n++;
+    }
+  }
+  release(&pcache.lock);
+  return n;
+}
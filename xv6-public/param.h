@@ -1,14 +1,30 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define HZ          100  // clock ticks per second
+#define NLEVEL        3  // MLFQ priority levels, 0 highest
+#define BOOSTTICKS  100  // ticks between MLFQ priority boosts
+#define MAXIDLE     100  // longest tickless idle of CPU 0, in ticks
+#define CACHEHOT      2  // ticks a stopped process stays cache-hot
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // unused i-nodes kept cached
+#define NPCACHE     256  // pages in the page cache of program files
+#define NZEROED     256  // free pages idle CPUs keep zeroed
+#define MAXORDER     10  // largest kalloc_pages block is 2^MAXORDER pages
+#define NSWAP     32768  // pages of swap space mkfs reserves on disk
+#define SWAPLOW     256  // kswapd pages out when fewer pages are free
+#define SWAPHIGH    512  // until this many are
+#define NSHM         16  // shared memory segments
+#define SHMPAGES   1024  // max pages in one; their pointers fill a page
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define LOGDEV        2  // device number of external log disk (ide disk 2)
+#define RAMDEV        3  // device number of the ram disk
+#define RAMDISKSIZE  64  // size of the ram disk in blocks
 #define MAXARG       32  // max exec arguments
+#define NSEG          4  // max loadable segments per program
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUF         (MAXOPBLOCKS*3)  // usual size of disk block cache
 //#define FSSIZE       1000  // size of file system in blocks
 #define FSSIZE       (4000000)  // size of file system in blocks
@@ -4,26 +4,385 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
 #include "spinlock.h"
-
+#include "proc.h"
+#include "traps.h"
+#include "pstat.h"
+
+// ptable.lock guards allocation of proc slots and the
+// parent/child links used by exit and wait.  Each proc's
+// state, chan and context switch are guarded by its own
+// p->lock, so scheduling never touches ptable.lock.
+//
+// Lock order: ptable.lock, then any sleep lock (lk), then
+// a wait queue lock, then p->lock, then a run queue lock.
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct files files[NPROC];  // each used by one or more procs
 } ptable;
 
+// Per-CPU run queues of RUNNABLE processes, linked through
+// p->rqnext.  A CPU runs processes from its own queue, and
+// steals from a busy neighbour only when it has nothing to do.
+// A RUNNABLE process is on exactly one queue, except between
+// being taken off one by a scheduler and being run.
+//
+// Each queue is a multi-level feedback queue: one list per
+// level, and the first process of the highest non-empty level
+// runs next.  A process starts at level 0 and drops a level
+// each time it uses up the quantum of its level; a process that
+// sleeps before then keeps its level.  Every BOOSTTICKS all
+// processes go back to level 0, so CPU hogs cannot starve.
+// A queued process's level fields change only under its
+// queue's lock.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NLEVEL];
+  struct proc *tail[NLEVEL];
+  int n;               // length; read without the lock as a hint
+} runqs[NCPU];
+
+static int quantum[NLEVEL] = { 1, 4, 16 };  // in ticks
+static uint boostgen;
+
+// Sleeping processes, hashed by chan, linked through p->wnext.
+// p->chan is set, and p is on waitq(p->chan), from the moment
+// it decides to sleep until it is woken; both change only
+// under that wait queue's lock.
+#define NWAITQ 64
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitqs[NWAITQ];
+
+static struct waitq*
+waitq(void *chan)
+{
+  // Multiplicative hash; the top bits are the best mixed.
+  return &waitqs[((uint)chan * 2654435761U) >> 26];
+}
+
 static struct proc *initproc;
+extern pde_t *kpgdir;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
-
 void
 pinit(void)
 {
+  struct proc *p;
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    initlock(&p->lock, "proc");
+  for(i = 0; i < NPROC; i++)
+    initlock(&ptable.files[i].lock, "files");
+  for(i = 0; i < NCPU; i++)
+    initlock(&runqs[i].lock, "runq");
+  for(i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
+}
+
+// Catch p up with a priority boost it slept or ran through.
+static void
+boosted(struct proc *p)
+{
+  if(p->boostgen != boostgen){
+    p->boostgen = boostgen;
+    p->level = 0;
+    p->tused = 0;
+  }
+}
+
+// Append p to its level's list on run queue rq.
+// Caller must hold rq->lock.
+static void
+rqappend(struct runq *rq, struct proc *p)
+{
+  p->rqnext = 0;
+  if(rq->tail[p->level])
+    rq->tail[p->level]->rqnext = p;
+  else
+    rq->head[p->level] = p;
+  rq->tail[p->level] = p;
+}
+
+// Send a wake-up IPI to CPU c, halted in idle().
+static void
+kick(int c)
+{
+  mycpu()->nwake++;
+  lapicipi(cpus[c].apicid, T_IRQ0 + IRQ_WAKE);
+}
+
+// Append p to the run queue of CPU c, and remember c.
+// If c is halted, wake it; if c is busy, wake a halted CPU
+// that may run p, so that it can steal p.
+static void
+rqput(int c, struct proc *p)
+{
+  struct runq *rq = &runqs[c];
+  uint mask = p->affinity;
+  int i, me;
+
+  acquire(&rq->lock);
+  p->cpu = c;
+  p->qtime = ticks;
+  boosted(p);
+  rqappend(rq, p);
+  rq->n++;
+  release(&rq->lock);
+
+  // release() has a full barrier, so c either sees the new
+  // rq->n before it halts or has set c->idle by now.
+  me = cpuid();
+  if(cpus[c].idle){
+    if(c != me)
+      kick(c);
+    return;
+  }
+  for(i = 0; i < ncpu; i++){
+    if(i != me && (mask & (1 << i)) && cpus[i].idle){
+      kick(i);
+      return;
+    }
+  }
+}
+
+// Take p off run queue rq, if it is there.
+// Caller must hold rq->lock.
+static int
+rqremove(struct runq *rq, struct proc *p)
+{
+  struct proc **pp, *prev;
+
+  prev = 0;
+  for(pp = &rq->head[p->level]; *pp; prev = *pp, pp = &(*pp)->rqnext){
+    if(*pp == p){
+      *pp = p->rqnext;
+      if(rq->tail[p->level] == p)
+        rq->tail[p->level] = prev;
+      p->rqnext = 0;
+      rq->n--;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Take the first process of the highest level off the
+// run queue of CPU c.
+static struct proc*
+rqget(int c)
+{
+  struct runq *rq = &runqs[c];
+  struct proc *p;
+  int l;
+
+  if(rq->n == 0)
+    return 0;
+  p = 0;
+  acquire(&rq->lock);
+  for(l = 0; l < NLEVEL; l++){
+    if((p = rq->head[l]) != 0){
+      rqremove(rq, p);
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Take a process that may run on CPU c off the run queue of
+// CPU v.  A process that stopped running less than CACHEHOT
+// ticks ago still has its cache and TLB state on v, so it is
+// left for v unless v has more waiting than that one.
+static struct proc*
+rqsteal(int v, int c)
+{
+  struct runq *rq = &runqs[v];
+  struct proc *p;
+  int l;
+
+  if(rq->n == 0)
+    return 0;
+  acquire(&rq->lock);
+  for(l = 0; l < NLEVEL; l++){
+    for(p = rq->head[l]; p; p = p->rqnext){
+      if(!(p->affinity & (1 << c)))
+        continue;
+      if(ticks - p->lastrun < CACHEHOT && rq->n < 2)
+        continue;
+      rqremove(rq, p);
+      release(&rq->lock);
+      return p;
+    }
+  }
+  release(&rq->lock);
+  return 0;
+}
+
+// Find work for idle CPU c on the other CPUs' queues,
+// starting with its neighbour, so that thieves spread out.
+// Takes one queue lock at a time.
+static struct proc*
+steal(int c)
+{
+  struct proc *p;
+  int i;
+
+  for(i = 1; i < ncpu; i++)
+    if((p = rqsteal((c + i) % ncpu, c)) != 0)
+      return p;
+  return 0;
+}
+
+// Of the CPUs in mask, the one with the shortest run queue.
+static int
+leastloaded(uint mask)
+{
+  int i, c;
+
+  c = -1;
+  for(i = 0; i < ncpu; i++)
+    if((mask & (1 << i)) && (c < 0 || runqs[i].n < runqs[c].n))
+      c = i;
+  if(c < 0)
+    panic("leastloaded: empty mask");
+  return c;
+}
+
+// CPU whose queue p should join: the one it last ran on,
+// whose cache is warm with it, if its affinity allows.
+static int
+pickcpu(struct proc *p)
+{
+  if(p->affinity & (1 << p->cpu))
+    return p->cpu;
+  return leastloaded(p->affinity);
+}
+
+// Make p RUNNABLE and queue it, preferably on the CPU it
+// last ran on.  Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  rqput(pickcpu(p), p);
+}
+
+// Halt CPU c, whose scheduler found nothing to run, until an
+// interrupt arrives.  A CPU that queues work for c wakes it
+// with an IPI (see rqput).
+//
+// CPU 0 keeps time.  While every CPU is idle there is nothing
+// to tick for until the next timer on the timer wheel, so CPU 0
+// sets its timer to fire once then, at most MAXIDLE ticks away,
+// and counts the ticks it missed when it wakes up; while some
+// other CPU is busy, CPU 0 goes on ticking as it halts.  The
+// other CPUs stop their timers whenever they halt.  A CPU that
+// stops being idle while CPU 0 is tickless wakes CPU 0 to
+// resume ticking.
+static void
+idle(struct cpu *c, int id)
+{
+  uint n, t;
+  int i;
+
+  cli();
+  xchg(&c->idle, 1);
+  if(runqs[id].n > 0){
+    xchg(&c->idle, 0);
+    return;
+  }
+
+  n = 0;
+  if(id == 0){
+    // Pairs with the idle/tickless check below, so that a CPU
+    // waking up either is seen here or sees tickless set.
+    xchg(&c->tickless, 1);
+    for(i = 1; i < ncpu; i++)
+      if(!cpus[i].idle)
+        break;
+    if(i == ncpu)
+      n = timernext(MAXIDLE);
+    else
+      c->tickless = 0;
+  }
+  if(id != 0)
+    lapiconeshot(0);
+  else if(n > 0)
+    lapiconeshot(n);
+
+  c->nhalt++;
+  t = usecs();
+  stihlt();
+  cli();
+
+  if(id != 0 || n > 0)
+    n = lapicperiodic(n);
+  c->tickless = 0;
+  if(n > 0)
+    addticks(n);
+  c->idleus += usecs() - t;
+
+  xchg(&c->idle, 0);
+  if(id != 0 && cpus[0].tickless)
+    kick(0);
+}
+
+// Move every process back to level 0.  Queued processes are
+// moved now; the others catch up (see boosted) the next time
+// they are queued or charged a tick.
+void
+boost(void)
+{
+  struct runq *rq;
+  struct proc *p;
+  int l;
+
+  boostgen++;
+  for(rq = runqs; rq < &runqs[ncpu]; rq++){
+    acquire(&rq->lock);
+    for(l = 1; l < NLEVEL; l++){
+      while((p = rq->head[l]) != 0){
+        rqremove(rq, p);
+        rq->n++;
+        boosted(p);
+        rqappend(rq, p);
+      }
+    }
+    release(&rq->lock);
+  }
+}
+
+// Charge the running process for a clock tick.  Returns 1 if
+// it should yield: it has used up its quantum, and drops a
+// level, or a process at a higher level is waiting on its CPU.
+// Called from the timer interrupt.
+int
+schedtick(void)
+{
+  struct proc *p = myproc();
+  int l;
+
+  p->rtime++;
+  boosted(p);
+  if(++p->tused >= quantum[p->level]){
+    if(p->level < NLEVEL-1)
+      p->level++;
+    p->tused = 0;
+    return 1;
+  }
+  for(l = 0; l < p->level; l++)
+    if(runqs[p->cpu].head[l])
+      return 1;
+  return 0;
 }
 
 // Must be called with interrupts disabled
@@ -88,6 +447,12 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->level = 0;
+  p->tused = 0;
+  p->boostgen = boostgen;
+  p->rtime = p->wtime = p->nswitch = 0;
+  p->nmigrate = 0;
+  p->pinlo = p->pinhi = 0;
 
   release(&ptable.lock);
 
@@ -140,40 +505,219 @@ userinit(void)
   p->tf->eip = 0;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/", 0); //기존 코드. set 0
+  if((p->files = allocfiles()) == 0)
+    panic("userinit: no files");
+  p->files->cwd = namei("/", 0); //기존 코드. set 0
 
   // this assignment to p->state lets other cores
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  acquire(&p->lock);
 
-  p->state = RUNNABLE;
+  p->cpu = 0;
+  p->affinity = ~0;
+  setrunnable(p);
+
+  release(&p->lock);
+}
+
+// Start a kernel thread running fn, which must not return.
+// It has no user memory, and runs only in the kernel.
+struct proc*
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kproc");
+  p->pgdir = kpgdir;
+  p->sz = 0;
+  // forkret returns to fn rather than trapret.
+  *(uint*)(p->context + 1) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&p->lock);
+  p->affinity = ~0;
+  p->cpu = leastloaded(p->affinity);
+  setrunnable(p);
+  release(&p->lock);
+  return p;
+}
+
+//PAGEBREAK!
+// For kswapd (see swapout), which calls these holding
+// faultlock, so that page tables are not freed under it.
+
+// The page table and size of the process in slot i of the
+// process table, or 0 if it has no user memory or is not
+// between running and exiting.
+pde_t*
+uservm(int i, uint *sz)
+{
+  struct proc *p = &ptable.proc[i];
 
+  if(p->state != SLEEPING && p->state != RUNNABLE)
+    return 0;
+  if(p->pgdir == 0 || p->sz == 0)
+    return 0;
+  *sz = p->sz;
+  return p->pgdir;
+}
+
+// Is a CPU running a process with page table pgdir?  The
+// scheduler sets c->proc before loading its page table and
+// clears it after, so that a page table no CPU runs has no
+// entries in any TLB.
+int
+vmrunning(pde_t *pgdir)
+{
+  struct cpu *c;
+  struct proc *p;
+
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    p = c->proc;
+    if(p && p->pgdir == pgdir)
+      return 1;
+  }
+  return 0;
+}
+
+// Has a process with page table pgdir pinned the page at va
+// for the system call it is in (see uvmpin)?
+int
+vmpinned(pde_t *pgdir, uint va)
+{
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pgdir == pgdir && va + PGSIZE > p->pinlo && va < p->pinhi)
+      return 1;
+  return 0;
+}
+
+// Number of procs using page table pgdir: more than one if
+// it belongs to a process with threads.
+// Caller must hold ptable.lock.
+static int
+nsharing(pde_t *pgdir)
+{
+  struct proc *p;
+  int n;
+
+  n = 0;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state != UNUSED && p->pgdir == pgdir)
+      n++;
+  return n;
+}
+
+// Does p have threads, or is it one?
+int
+sharedvm(struct proc *p)
+{
+  int n;
+
+  acquire(&ptable.lock);
+  n = nsharing(p->pgdir);
   release(&ptable.lock);
+  return n > 1;
 }
 
-// Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Grow current process's memory by n bytes, for it and the
+// threads sharing its memory.  ptable.lock keeps threads
+// from growing it at the same time.  Growing only reserves
+// the addresses: uvmfault allocates each page when first
+// touched.
+// Return the old size, or -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint sz, oldsz;
   struct proc *curproc = myproc();
+  struct proc *p;
 
-  sz = curproc->sz;
+  acquire(&ptable.lock);
+  sz = oldsz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
+    if(sz + n >= SHMBASE)
+      goto bad;
+    sz += n;
   } else if(n < 0){
+    // Another CPU may be running a thread with the freed pages
+    // still in its TLB, and xv6 has no TLB shootdown, so only
+    // a process without threads can shrink.
+    if(nsharing(curproc->pgdir) > 1)
+      goto bad;
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
-      return -1;
+      goto bad;
   }
-  curproc->sz = sz;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state != UNUSED && p->pgdir == curproc->pgdir)
+      p->sz = sz;
+  release(&ptable.lock);
   switchuvm(curproc);
+  return oldsz;
+
+bad:
+  release(&ptable.lock);
+  return -1;
+}
+
+// Allocate an empty files table, with one reference.
+struct files*
+allocfiles(void)
+{
+  struct files *f;
+
+  acquire(&ptable.lock);
+  for(f = ptable.files; f < &ptable.files[NPROC]; f++){
+    if(f->ref == 0){
+      f->ref = 1;
+      release(&ptable.lock);
+      memset(f->ofile, 0, sizeof(f->ofile));
+      f->cwd = 0;
+      return f;
+    }
+  }
+  release(&ptable.lock);
   return 0;
 }
 
+// Drop a reference to f; the last one closes its files.
+// Only procs using f take references to it, so once the
+// caller holds the last one, no one else can get it.
+static void
+putfiles(struct files *f)
+{
+  int fd;
+
+  acquire(&ptable.lock);
+  if(f->ref > 1){
+    f->ref--;
+    release(&ptable.lock);
+    return;
+  }
+  release(&ptable.lock);
+
+  for(fd = 0; fd < NOFILE; fd++){
+    if(f->ofile[fd]){
+      fileclose(f->ofile[fd]);
+      f->ofile[fd] = 0;
+    }
+  }
+  if(f->cwd){
+    begin_op();
+    iput(f->cwd);
+    end_op();
+    f->cwd = 0;
+  }
+
+  acquire(&ptable.lock);
+  f->ref = 0;
+  release(&ptable.lock);
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -190,7 +734,14 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  // Share pages copy-on-write, unless curproc has threads
+  // (see uncow).
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz,
+                          !sharedvm(curproc))) == 0 ||
+     (np->files = allocfiles()) == 0){
+    if(np->pgdir)
+      freevm(np->pgdir);
+    np->pgdir = 0;
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
@@ -203,21 +754,87 @@ fork(void)
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
+  acquire(&curproc->files->lock);
   for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+    if(curproc->files->ofile[i])
+      np->files->ofile[i] = filedup(curproc->files->ofile[i]);
+  np->files->cwd = idup(curproc->files->cwd);
+  release(&curproc->files->lock);
+  np->exe = curproc->exe ? itext(idup(curproc->exe)) : 0;
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
   pid = np->pid;
 
-  acquire(&ptable.lock);
+  acquire(&np->lock);
+
+  np->affinity = curproc->affinity;
+  np->cpu = leastloaded(np->affinity);
+  setrunnable(np);
+
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a thread: a process sharing the caller's memory and
+// files.  It starts running fn(arg) on the one-page user stack
+// at stack, and must call exit() rather than return from fn.
+// Returns its pid, or -1.
+int
+clone(void (*fn)(void*), void *arg, void *stack)
+{
+  int pid;
+  uint sp, ustack[2];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  // Fake return PC and argument for fn.
+  ustack[0] = 0xffffffff;
+  ustack[1] = (uint)arg;
+  sp = (uint)stack + PGSIZE - sizeof(ustack);
+  if(sp + sizeof(ustack) > curproc->sz ||
+     uvmpin(curproc, sp, sizeof(ustack), 1) < 0 ||
+     copyout(curproc->pgdir, sp, ustack, sizeof(ustack)) < 0)
+    return -1;
+
+  // The first thread ends copy-on-write sharing with other
+  // processes (see uncow); later ones find none.
+  if(!sharedvm(curproc) && uncow(curproc->pgdir, curproc->sz) < 0)
+    return -1;
 
-  np->state = RUNNABLE;
+  if((np = allocproc()) == 0)
+    return -1;
 
+  // Under ptable.lock, so that growproc sees the new thread.
+  acquire(&ptable.lock);
+  np->pgdir = curproc->pgdir;
+  np->sz = curproc->sz;
+  np->files = curproc->files;
+  np->files->ref++;
   release(&ptable.lock);
 
+  np->parent = curproc;
+  np->ustack = stack;
+  np->exe = curproc->exe ? itext(idup(curproc->exe)) : 0;
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
+  *np->tf = *curproc->tf;
+  np->tf->esp = sp;
+  np->tf->eip = (uint)fn;
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = np->pid;
+
+  acquire(&np->lock);
+
+  np->affinity = curproc->affinity;
+  np->cpu = leastloaded(np->affinity);
+  setrunnable(np);
+
+  release(&np->lock);
+
   return pid;
 }
 
@@ -229,51 +846,56 @@ exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
+  // Close all open files, unless threads still use them.
+  putfiles(curproc->files);
+  curproc->files = 0;
+  if(curproc->exe){
+    iuntext(curproc->exe);
+    begin_op();
+    iput(curproc->exe);
+    end_op();
+    curproc->exe = 0;
   }
 
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
-
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   // Pass abandoned children to init.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->parent == curproc){
       p->parent = initproc;
       if(p->state == ZOMBIE)
-        wakeup1(initproc);
+        wakeup(initproc);
     }
   }
 
-  // Jump into the scheduler, never to return.
+  // Jump into the scheduler, never to return.  The parent
+  // can see ZOMBIE once ptable.lock is released, but must
+  // take curproc->lock before freeing the stack we are on,
+  // and the scheduler releases it only after the switch.
+  acquire(&curproc->lock);
   curproc->state = ZOMBIE;
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
-int
-wait(void)
+// Wait for a child to exit and return its pid: a child
+// process if thread is 0, else a thread from clone, whose
+// user stack is stored in *stack.
+// Return -1 if this process has no such children.
+static int
+waitchild(int thread, void **stack)
 {
   struct proc *p;
   int havekids, pid;
+  void *ustack;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
@@ -281,23 +903,32 @@ wait(void)
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+      if(p->parent != curproc || (p->pgdir == curproc->pgdir) != thread)
         continue;
       havekids = 1;
+      acquire(&p->lock);
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
+        ustack = p->ustack;
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir);
+        if(nsharing(p->pgdir) == 1)
+          freevm(p->pgdir);
+        p->pgdir = 0;
+        p->ustack = 0;
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
         p->state = UNUSED;
+        release(&p->lock);
         release(&ptable.lock);
+        if(stack)
+          *stack = ustack;
         return pid;
       }
+      release(&p->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -311,6 +942,23 @@ wait(void)
   }
 }
 
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(void)
+{
+  return waitchild(0, 0);
+}
+
+// Wait for a thread created by clone to exit and return its
+// pid, storing the user stack it was given in *stack.
+// Return -1 if this process has no threads.
+int
+join(void **stack)
+{
+  return waitchild(1, stack);
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -324,38 +972,60 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
+    // Take the next process from this CPU's run queue,
+    // or from another CPU's if ours is empty.  With nothing
+    // to run, zero a free page for kalloc_zeroed, one at a
+    // time so as to notice new work soon, or else halt.
+    if((p = rqget(id)) == 0 && (p = steal(id)) == 0){
+      if(!kzero())
+        idle(c, id);
+      continue;
+    }
 
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
+    // If p was queued on its way into sched() on another
+    // CPU, this waits until it has switched out.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: queued proc not runnable");
+
+    // Its affinity may have changed while it was off the
+    // queues on its way here.
+    if(!(p->affinity & (1 << id))){
+      rqput(pickcpu(p), p);
+      release(&p->lock);
+      continue;
     }
-    release(&ptable.lock);
 
+    // Switch to chosen process.  It is the process's job
+    // to release p->lock and then reacquire it
+    // before jumping back to us.
+    c->proc = p;
+    if(p->cpu != id)
+      p->nmigrate++;
+    p->cpu = id;
+    p->wtime += ticks - p->qtime;
+    p->nswitch++;
+    switchuvm(p);
+    p->state = RUNNING;
+
+    swtch(&(c->scheduler), p->context);
+    switchkvm();
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -368,8 +1038,8 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&p->lock))
+    panic("sched p->lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
@@ -377,6 +1047,7 @@ sched(void)
   if(readeflags()&FL_IF)
     panic("sched interruptible");
   intena = mycpu()->intena;
+  p->lastrun = ticks;
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
 }
@@ -385,10 +1056,12 @@ sched(void)
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(&p->lock);  //DOC: yieldlock
+  setrunnable(p);
   sched();
-  release(&ptable.lock);
+  release(&p->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -397,8 +1070,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -407,6 +1080,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -418,6 +1092,7 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq;
   
   if(p == 0)
     panic("sleep");
@@ -425,52 +1100,99 @@ sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
-  // Go to sleep.
+  // Join chan's wait queue and take p->lock before
+  // releasing lk.  A wakeup after that finds p on the
+  // queue, and waits for p->lock, which we hold until
+  // we are switched out, so it won't be missed.
+  wq = waitq(chan);
+  acquire(&wq->lock);  //DOC: sleeplock1
+  acquire(&p->lock);
   p->chan = chan;
+  p->wnext = wq->head;
+  wq->head = p;
+  release(&wq->lock);
+  release(lk);
+
+  // Go to sleep.
   p->state = SLEEPING;
 
   sched();
 
-  // Tidy up.
-  p->chan = 0;
-
+  // Wakeup has taken p off the queue and cleared p->chan.
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  release(&p->lock);  //DOC: sleeplock2
+  acquire(lk);
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
+// Take p off wait queue wq and make it runnable.
+// Caller must hold wq->lock.
 static void
-wakeup1(void *chan)
+unsleep(struct waitq *wq, struct proc *p)
 {
-  struct proc *p;
+  struct proc **pp;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  for(pp = &wq->head; *pp != p; pp = &(*pp)->wnext)
+    ;
+  *pp = p->wnext;
+  p->wnext = 0;
+
+  // p may still be on its way into sched(); wait for it.
+  acquire(&p->lock);
+  p->chan = 0;
+  setrunnable(p);
+  release(&p->lock);
 }
 
 // Wake up all processes sleeping on chan.
+// Only chan's wait queue is examined.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  struct waitq *wq;
+  struct proc *p, *next;
+
+  wq = waitq(chan);
+  acquire(&wq->lock);
+  for(p = wq->head; p; p = next){
+    next = p->wnext;
+    if(p->chan == chan)
+      unsleep(wq, p);
+  }
+  release(&wq->lock);
+}
+
+// Wake up at most n processes sleeping on chan, those that
+// have slept longest first.  Returns the number woken.
+int
+wakeupn(void *chan, int n)
+{
+  struct waitq *wq;
+  struct proc *p, *next;
+  int skip, woken;
+
+  wq = waitq(chan);
+  acquire(&wq->lock);
+  // The queue is newest first: skip all but the last n.
+  skip = 0;
+  for(p = wq->head; p; p = p->wnext)
+    if(p->chan == chan)
+      skip++;
+  skip = skip > n ? skip - n : 0;
+  woken = 0;
+  for(p = wq->head; p; p = next){
+    next = p->wnext;
+    if(p->chan != chan)
+      continue;
+    if(skip > 0){
+      skip--;
+      continue;
+    }
+    unsleep(wq, p);
+    woken++;
+  }
+  release(&wq->lock);
+  return woken;
 }
 
 // Kill the process with the given pid.
@@ -480,14 +1202,23 @@ int
 kill(int pid)
 {
   struct proc *p;
+  struct waitq *wq;
+  void *chan;
 
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
       p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      // Wake process from sleep if necessary.  p->chan
+      // only changes under its wait queue's lock, so
+      // check it again once that lock is held.
+      if((chan = p->chan) != 0){
+        wq = waitq(chan);
+        acquire(&wq->lock);
+        if(p->chan == chan)
+          unsleep(wq, p);
+        release(&wq->lock);
+      }
       release(&ptable.lock);
       return 0;
     }
@@ -496,6 +1227,136 @@ kill(int pid)
   return -1;
 }
 
+// Set the MLFQ level of process pid; returns the old one.
+int
+setpriority(int pid, int level)
+{
+  struct proc *p;
+  struct runq *rq;
+  int old, queued;
+
+  if(level < 0 || level >= NLEVEL)
+    return -1;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid != pid || p->state == UNUSED)
+      continue;
+    acquire(&p->lock);
+    rq = &runqs[p->cpu];
+    acquire(&rq->lock);
+    old = p->level;
+    queued = p->state == RUNNABLE && rqremove(rq, p);
+    p->boostgen = boostgen;
+    p->level = level;
+    p->tused = 0;
+    if(queued){
+      rqappend(rq, p);
+      rq->n++;
+    }
+    release(&rq->lock);
+    release(&p->lock);
+    release(&ptable.lock);
+    return old;
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Restrict process pid (0: the caller) to the CPUs in mask.
+// A queued process moves at once; a running one moves the
+// next time it gives up its CPU.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+  struct runq *rq;
+  int queued;
+
+  mask &= (1 << ncpu) - 1;
+  if(mask == 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid != pid || p->state == UNUSED)
+      continue;
+    acquire(&p->lock);
+    p->affinity = mask;
+    if(p->state == RUNNABLE && !(mask & (1 << p->cpu))){
+      rq = &runqs[p->cpu];
+      acquire(&rq->lock);
+      queued = rqremove(rq, p);
+      release(&rq->lock);
+      if(queued)
+        rqput(pickcpu(p), p);
+    }
+    release(&p->lock);
+    release(&ptable.lock);
+    return 0;
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+static char *states[] = {
+[UNUSED]    "unused",
+[EMBRYO]    "embryo",
+[SLEEPING]  "sleep ",
+[RUNNABLE]  "runble",
+[RUNNING]   "run   ",
+[ZOMBIE]    "zombie"
+};
+
+// Copy a snapshot of up to n processes to ps.
+// Returns the number copied.
+int
+getprocs(struct pstat *ps, int n)
+{
+  struct proc *p;
+  int i;
+
+  i = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && i < n; p++){
+    if(p->state == UNUSED)
+      continue;
+    ps[i].pid = p->pid;
+    safestrcpy(ps[i].name, p->name, sizeof(ps[i].name));
+    safestrcpy(ps[i].state, states[p->state], sizeof(ps[i].state));
+    ps[i].level = p->level;
+    ps[i].cpu = p->cpu;
+    ps[i].sz = p->sz;
+    ps[i].rtime = p->rtime;
+    ps[i].wtime = p->wtime;
+    ps[i].nswitch = p->nswitch;
+    ps[i].affinity = p->affinity;
+    ps[i].nmigrate = p->nmigrate;
+    i++;
+  }
+  release(&ptable.lock);
+  return i;
+}
+
+// Copy the statistics of up to n CPUs to cs.
+// Returns the number copied.
+int
+getcpustats(struct cpustat *cs, int n)
+{
+  struct cpu *c;
+  int i;
+
+  for(i = 0; i < ncpu && i < n; i++){
+    c = &cpus[i];
+    cs[i].cpu = i;
+    cs[i].nhalt = c->nhalt;
+    cs[i].idleus = c->idleus;
+    cs[i].nspin = c->nspin;
+    cs[i].nwake = c->nwake;
+  }
+  return i;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
@@ -503,14 +1364,6 @@ kill(int pid)
 void
 procdump(void)
 {
-  static char *states[] = {
-  [UNUSED]    "unused",
-  [EMBRYO]    "embryo",
-  [SLEEPING]  "sleep ",
-  [RUNNABLE]  "runble",
-  [RUNNING]   "run   ",
-  [ZOMBIE]    "zombie"
-  };
   int i;
   struct proc *p;
   char *state;
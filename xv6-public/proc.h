@@ -8,6 +8,12 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile uint idle;          // Halted, or about to halt, with nothing to run
+  volatile uint tickless;      // CPU 0 only: timer stopped while idle
+  uint nhalt;                  // Times halted
+  uint idleus;                 // Microseconds spent halted
+  uint nspin;                  // Lock acquisitions that had to spin
+  uint nwake;                  // Wake-up IPIs sent to idle CPUs
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,8 +40,29 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// Open files and current directory, shared by a process and
+// the threads it creates with clone.
+struct files {
+  struct spinlock lock;        // Protects ofile and cwd
+  int ref;                     // Procs using it; guarded by ptable.lock
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+};
+
+// A loadable segment of a program file, paged in on demand:
+// memsz bytes at va, of which the first filesz come from the
+// file at off and the rest are zero.
+struct seg {
+  uint va;
+  uint memsz;
+  uint off;
+  uint filesz;
+  int writable;
+};
+
 // Per-process state
 struct proc {
+  struct spinlock lock;        // Protects state, chan and the switch
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
@@ -44,15 +71,40 @@ struct proc {
   struct proc *parent;         // Parent process
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
-  void *chan;                  // If non-zero, sleeping on chan
+  void *chan;                  // If non-zero, on chan's wait queue
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct files *files;         // Open files and current directory
   char name[16];               // Process name (debugging)
+  int cpu;                     // Run queue it is on or last ran from
+  struct proc *rqnext;         // Next in run queue
+  struct proc *wnext;          // Next sleeper in the same wait queue
+  int level;                   // MLFQ level, 0 is highest
+  int tused;                   // Ticks of its quantum used at this level
+  uint boostgen;               // Last priority boost it has seen
+  uint rtime;                  // Ticks running
+  uint wtime;                  // Ticks runnable, waiting for a CPU
+  uint qtime;                  // When it was last queued
+  uint nswitch;                // Times scheduled
+  uint affinity;               // CPUs it may run on, bit per cpus[] index
+  uint lastrun;                // When it last stopped running
+  uint nmigrate;               // Times it ran on a different CPU than before
+  uint wakeat;                 // Tick to wake at, while on the timer wheel
+  struct proc **tlink;         // Link to it in its timer wheel slot, or 0
+  struct proc *tnext;          // Next in the same timer wheel slot
+  void *ustack;                // User stack given to clone, if a thread
+  struct inode *exe;           // Program file it runs, if exec'd
+  struct seg seg[NSEG];        // Loadable segments of exe
+  uint pinlo, pinhi;           // User memory the current syscall pinned
 };
 
+// A thread is a process created by clone: it shares its
+// parent's page table, size and files, and has its own user
+// stack.  Procs with the same pgdir are threads of one process.
+
 // Process memory is laid out contiguously, low addresses first:
 //   text
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+// and then, from SHMBASE up, any shared memory segments
+// attached (see shm.c).
@@ -0,0 +1,38 @@
+// Process statistics, as returned by the getprocs system call.
+// Both the kernel and user programs use this header file.
+
+struct pstat {
+  int pid;
+  char name[16];
+  char state[8];
+  int level;      // MLFQ level, 0 is highest
+  int cpu;        // CPU it runs on or last ran on
+  uint sz;        // memory size (bytes)
+  uint rtime;     // ticks running
+  uint wtime;     // ticks runnable, waiting for a CPU
+  uint nswitch;   // times scheduled
+  uint affinity;  // CPUs it may run on, one bit per CPU
+  uint nmigrate;  // times moved to another CPU
+};
+
+// Per-CPU statistics, as returned by the cpustat system call.
+struct cpustat {
+  int cpu;
+  uint nhalt;      // times halted with nothing to run
+  uint idleus;     // microseconds spent halted
+  uint nspin;      // lock acquisitions that had to spin
+  uint nwake;      // wake-up IPIs sent to idle CPUs
+};
+
+// Free memory, in pages, as returned by the meminfo system call.
+struct meminfo {
+  uint npage;                 // pages the allocator manages
+  uint nfree;                 // free pages, all of them
+  uint ncached;               // free pages held by CPU caches
+  uint nzeroed;               // free pages zeroed ahead of time
+  uint nblock[MAXORDER+1];    // free blocks of 2^k pages, for each k
+  uint nswap;                 // pages of swap space
+  uint nswapped;              // of those, holding paged-out pages
+  uint npageout;              // pages paged out since boot
+  uint npagein;               // pages read back in
+};
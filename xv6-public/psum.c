@@ -0,0 +1,84 @@
+// psum: parallel sum with threads.
+//   psum [maxthreads [n]]
+// Sums an array of n ints (default 1M) with 1, 2, ... up to
+// maxthreads threads (default 4), each summing a slice, and
+// reports the time and speedup of each.  Run it under
+// make CPUS=1, 2, 4 ... to see how it scales with -smp.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MAXTHREADS 16
+#define REPEAT     10
+
+int *a;
+int n, nthreads;
+int part[MAXTHREADS];
+
+void
+worker(void *arg)
+{
+  int id, i, lo, hi, r, sum;
+
+  id = (int)arg;
+  lo = n / nthreads * id;
+  hi = id == nthreads - 1 ? n : lo + n / nthreads;
+  sum = 0;
+  for(r = 0; r < REPEAT; r++)
+    for(i = lo; i < hi; i++)
+      sum += a[i];
+  part[id] = sum;
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxthreads, i, sum, want;
+  uint t0, t, t1;
+
+  maxthreads = argc > 1 ? atoi(argv[1]) : 4;
+  n = argc > 2 ? atoi(argv[2]) : 1024*1024;
+  if(maxthreads < 1 || maxthreads > MAXTHREADS || n < 1){
+    printf(2, "usage: psum [maxthreads (1-%d) [n]]\n", MAXTHREADS);
+    exit();
+  }
+  if((a = (int*)sbrk(n * sizeof(int))) == (int*)-1){
+    printf(2, "psum: out of memory\n");
+    exit();
+  }
+  want = 0;
+  for(i = 0; i < n; i++){
+    a[i] = i & 0xff;
+    want += a[i];
+  }
+  want *= REPEAT;
+
+  t1 = 0;
+  for(nthreads = 1; nthreads <= maxthreads; nthreads++){
+    t0 = usecs();
+    for(i = 0; i < nthreads; i++){
+      if(thread_create(worker, (void*)i) < 0){
+        printf(2, "psum: thread_create failed\n");
+        exit();
+      }
+    }
+    for(i = 0; i < nthreads; i++)
+      thread_join();
+    t = (usecs() - t0) / 1000;
+
+    sum = 0;
+    for(i = 0; i < nthreads; i++)
+      sum += part[i];
+    if(nthreads == 1)
+      t1 = t;
+    printf(1, "psum: %d threads: %d ms", nthreads, t);
+    if(t > 0)
+      printf(1, ", speedup %d.%d", t1 / t, t1 * 10 / t % 10);
+    if(sum != want)
+      printf(1, ", WRONG SUM");
+    printf(1, "\n");
+  }
+  exit();
+}
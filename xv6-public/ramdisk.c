@@ -0,0 +1,39 @@
+// Memory-backed block device (RAMDEV).
+// Its contents do not survive a reboot, so it is only
+// useful for scratch data, e.g. an in-memory log when
+// benchmarking the journal (mkfs -r).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+static uchar ramdisk[RAMDISKSIZE*BSIZE];
+
+// Sync buf with the ram disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+ramdiskrw(struct buf *b)
+{
+  uchar *p;
+
+  if(!holdingsleep(&b->lock))
+    panic("ramdiskrw: buf not locked");
+  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+    panic("ramdiskrw: nothing to do");
+  if(b->blockno >= RAMDISKSIZE)
+    panic("ramdiskrw: block out of range");
+
+  p = ramdisk + b->blockno*BSIZE;
+
+  if(b->flags & B_DIRTY){
+    b->flags &= ~B_DIRTY;
+    memmove(p, b->data, BSIZE);
+  } else
+    memmove(b->data, p, BSIZE);
+  b->flags |= B_VALID;
+}
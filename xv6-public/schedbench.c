@@ -0,0 +1,74 @@
+// schedbench: CPU-bound fork storm.
+//   schedbench [nproc [work]]
+// Forks nproc children that each spin through the same amount
+// of work, and reports how long each took (fairness: the
+// spread between the fastest and slowest) and how much work
+// per second they got done together (throughput).
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MAXCHILD 32
+
+int
+spin(int work)
+{
+  volatile int x;
+  int i, j;
+
+  x = 0;
+  for(i = 0; i < work; i++)
+    for(j = 0; j < 100000; j++)
+      x += j;
+  return x;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, work, i, min, max, sum, fd[2];
+  uint t, t0;
+
+  nproc = argc > 1 ? atoi(argv[1]) : 16;
+  work = argc > 2 ? atoi(argv[2]) : 100;
+  if(nproc < 1 || nproc > MAXCHILD || work < 1){
+    printf(2, "usage: schedbench [nproc (1-%d) [work]]\n", MAXCHILD);
+    exit();
+  }
+  if(pipe(fd) < 0){
+    printf(2, "schedbench: pipe failed\n");
+    exit();
+  }
+
+  t0 = usecs();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      spin(work);
+      t = (usecs() - t0) / 1000;
+      write(fd[1], &t, sizeof(t));
+      exit();
+    }
+  }
+  close(fd[1]);
+
+  min = max = -1;  // ms
+  sum = 0;
+  for(i = 0; i < nproc && read(fd[0], &t, sizeof(t)) == sizeof(t); i++){
+    if(min < 0 || t < min)
+      min = t;
+    if(t > max)
+      max = t;
+    sum += t;
+  }
+  for(i = 0; i < nproc; i++)
+    wait();
+  t = (usecs() - t0) / 1000;
+
+  printf(1, "schedbench: %d procs x %d work in %d ms\n", nproc, work, t);
+  printf(1, "  finish: min %d avg %d max %d ms\n", min, sum/nproc, max);
+  if(t > 0)
+    printf(1, "  throughput: %d work/s\n", nproc*work*1000/t);
+  exit();
+}
@@ -0,0 +1,282 @@
+// Shared memory: segments of pages that several processes map
+// at once, so that they can pass data without copying it
+// through the kernel as pipes do.
+//
+// shmget finds or creates the segment with a key, shmat maps
+// it into the caller's memory and shmdt unmaps it.  The segment
+// in table slot i is always mapped at SHMADDR(i), between the
+// heap's limit (SHMBASE) and KERNBASE, so a segment's address
+// is the same in every process and pointers into it can be
+// shared.  Its id also counts the segments the slot has held,
+// so that a stale id does not find a later segment.  fork
+// maps the parent's segments into the child too (see copyuvm),
+// and exec and exit unmap them (see freevm).
+//
+// The segment holds a reference to each of its pages, and each
+// page table mapping it one more (see kalloc), so a page is
+// freed once the segment and every mapping have let it go.
+// With two references or more, kswapd leaves them in memory.
+// A segment lasts until the last page table that attached it
+// detaches, or, if none ever does, until its creator's does
+// (see shmdrop).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define SHMADDR(i)  (SHMBASE + (i)*SHMPAGES*PGSIZE)
+#define SHMID(s)    ((s)->seq*NSHM + ((s) - shm.seg))
+#define SHMMAXSEQ   (0x7FFFFFFF/NSHM)  // keeps ids positive
+
+struct shmseg {
+  int key;          // 0 if the entry is free
+  uint seq;         // segments the slot has held
+  int npages;
+  char **page;      // a page of pointers to the segment's pages
+  int nattach;      // page tables mapping it
+  pde_t *creator;   // page table of the process that made it
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shm;
+
+void
+shminit(void)
+{
+  initlock(&shm.lock, "shm");
+}
+
+static void
+freepages(char **page, int n)
+{
+  while(--n >= 0)
+    kfree(page[n]);
+  kfree((char*)page);
+}
+
+static void
+shmfree(struct shmseg *s)
+{
+  freepages(s->page, s->npages);
+  s->key = 0;
+}
+
+// Whether pgdir maps the segment in slot i.  Caller must hold
+// shm.lock.
+static int
+attached(pde_t *pgdir, int i)
+{
+  return shm.seg[i].key != 0 && uva2ka(pgdir, (char*)SHMADDR(i)) != 0;
+}
+
+// The segment with key, or 0.  Caller must hold shm.lock.
+static struct shmseg*
+shmlookup(int key)
+{
+  struct shmseg *s;
+
+  for(s = shm.seg; s < &shm.seg[NSHM]; s++)
+    if(s->key == key)
+      return s;
+  return 0;
+}
+
+// Return the id of the segment with key, creating it with
+// size bytes of zeroes if there is none.  Returns -1 if key
+// is not positive, the segment is smaller than size, or there
+// is no room for a new one.
+int
+shmget(int key, uint size)
+{
+  struct shmseg *s;
+  char **page;
+  int i, n;
+
+  n = PGROUNDUP(size) / PGSIZE;
+  if(key <= 0 || n == 0 || n > SHMPAGES)
+    return -1;
+
+  acquire(&shm.lock);
+  if((s = shmlookup(key)) != 0){
+    i = s->npages >= n ? SHMID(s) : -1;
+    release(&shm.lock);
+    return i;
+  }
+  release(&shm.lock);
+
+  // Allocate without shm.lock, so that kalloc can wait for
+  // kswapd.
+  if((page = (char**)kalloc()) == 0)
+    return -1;
+  for(i = 0; i < n; i++){
+    if((page[i] = kalloc_zeroed()) == 0){
+      freepages(page, i);
+      return -1;
+    }
+  }
+
+  acquire(&shm.lock);
+  if((s = shmlookup(key)) != 0){
+    // Another process created it first.
+    i = s->npages >= n ? SHMID(s) : -1;
+    release(&shm.lock);
+    freepages(page, n);
+    return i;
+  }
+  if((s = shmlookup(0)) == 0){
+    release(&shm.lock);
+    freepages(page, n);
+    return -1;
+  }
+  s->key = key;
+  s->seq = (s->seq + 1) % SHMMAXSEQ;
+  s->npages = n;
+  s->page = page;
+  s->nattach = 0;
+  s->creator = myproc()->pgdir;
+  i = SHMID(s);
+  release(&shm.lock);
+  return i;
+}
+
+//PAGEBREAK!
+// Map segment id into the current process's memory, and
+// return its address, or -1.  Threads sharing the memory see
+// it too.
+int
+shmat(int id)
+{
+  struct proc *p = myproc();
+  struct shmseg *s;
+  int i;
+
+  if(id < 0)
+    return -1;
+  i = id % NSHM;
+  s = &shm.seg[i];
+  acquire(&shm.lock);
+  if(s->key == 0 || SHMID(s) != id){
+    release(&shm.lock);
+    return -1;
+  }
+  if(!attached(p->pgdir, i)){
+    if(shareuvm(p->pgdir, SHMADDR(i), s->page, s->npages) < 0){
+      release(&shm.lock);
+      return -1;
+    }
+    s->nattach++;
+  }
+  release(&shm.lock);
+  return SHMADDR(i);
+}
+
+// Unmap the segment at addr from the current process's
+// memory, freeing it if no one else has it attached.
+// Returns 0, or -1 if no segment is attached there.
+int
+shmdt(uint addr)
+{
+  struct proc *p = myproc();
+  struct shmseg *s;
+  int i;
+
+  if(addr < SHMBASE || addr >= KERNBASE)
+    return -1;
+  i = (addr - SHMBASE) / (SHMPAGES*PGSIZE);
+  if(addr != SHMADDR(i))
+    return -1;
+  // Without TLB shootdowns, a thread on another CPU could go
+  // on using the pages (see growproc).
+  if(sharedvm(p))
+    return -1;
+  s = &shm.seg[i];
+  acquire(&shm.lock);
+  if(!attached(p->pgdir, i)){
+    release(&shm.lock);
+    return -1;
+  }
+  deallocuvm(p->pgdir, addr + s->npages*PGSIZE, addr);
+  if(--s->nattach == 0)
+    shmfree(s);
+  release(&shm.lock);
+  switchuvm(p);
+  return 0;
+}
+
+//PAGEBREAK!
+// Map the segments attached to pgdir into d as well, for fork.
+// Returns 0, or -1 if out of memory.
+int
+shmcopy(pde_t *pgdir, pde_t *d)
+{
+  struct shmseg *s;
+  int i;
+
+  acquire(&shm.lock);
+  for(i = 0; i < NSHM; i++){
+    s = &shm.seg[i];
+    if(!attached(pgdir, i))
+      continue;
+    if(shareuvm(d, SHMADDR(i), s->page, s->npages) < 0){
+      release(&shm.lock);
+      return -1;
+    }
+    s->nattach++;
+  }
+  release(&shm.lock);
+  return 0;
+}
+
+// pgdir is being freed: detach it from its segments, and free
+// those no one else has attached, including the ones it
+// created that were never attached.  freevm drops the
+// mappings' references to the pages.
+void
+shmdrop(pde_t *pgdir)
+{
+  struct shmseg *s;
+  int i, dropped;
+
+  acquire(&shm.lock);
+  for(i = 0; i < NSHM; i++){
+    s = &shm.seg[i];
+    if(s->key == 0)
+      continue;
+    dropped = 0;
+    if(attached(pgdir, i)){
+      s->nattach--;
+      dropped = 1;
+    }
+    if(s->creator == pgdir){
+      s->creator = 0;
+      dropped = 1;
+    }
+    if(dropped && s->nattach == 0)
+      shmfree(s);
+  }
+  release(&shm.lock);
+}
+
+// Whether the n bytes at va lie in a segment attached to
+// pgdir, for system calls checking user addresses past the
+// process size.
+int
+shmvalid(pde_t *pgdir, uint va, uint n)
+{
+  int i, ok;
+
+  if(va < SHMBASE || va >= KERNBASE || va + n < va)
+    return 0;
+  i = (va - SHMBASE) / (SHMPAGES*PGSIZE);
+  acquire(&shm.lock);
+  ok = attached(pgdir, i) &&
+       va + n <= SHMADDR(i) + shm.seg[i].npages*PGSIZE;
+  release(&shm.lock);
+  return ok;
+}
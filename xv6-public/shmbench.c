@@ -0,0 +1,179 @@
+// shmbench: bulk transfer through a pipe and through shared
+// memory.
+//   shmbench [mb [kb]]
+// A producer process hands mb megabytes (default 64) to a
+// consumer process in chunks of kb kilobytes (default 64),
+// first through a pipe, then through a ring of chunks in a
+// shared memory segment, which the producer fills and the
+// consumer reads in place.  The consumer checksums the data
+// either way, and the time each way takes is printed.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PG    4096
+#define NSLOT 8     // chunks in the shared ring
+
+// At the start of the segment; the chunks follow, from PG.
+struct ring {
+  struct mutex m;
+  struct cond nonempty, nonfull;
+  uint head;    // chunks produced
+  uint tail;    // chunks consumed
+  uint sum;     // of the words consumed
+};
+
+uint nchunk, nword;  // nword per chunk
+
+void
+fill(uint *w, uint i)
+{
+  uint j;
+
+  for(j = 0; j < nword; j++)
+    w[j] = i*nword + j;
+}
+
+uint
+sum(uint *w)
+{
+  uint j, s;
+
+  s = 0;
+  for(j = 0; j < nword; j++)
+    s += w[j];
+  return s;
+}
+
+void
+report(char *how, int mb, uint t0, uint got, uint want)
+{
+  uint ms;
+
+  ms = (usecs() - t0) / 1000;
+  printf(1, "%s: %d MB in %d ms, %d MB/s%s\n", how, mb, ms,
+    ms ? mb * 1000 / ms : 0, got == want ? "" : " (WRONG)");
+}
+
+// Send the chunks through a pipe.  The consumer writes its
+// sum back through a second one.
+uint
+viapipe(uint *buf)
+{
+  int data[2], back[2], n, have;
+  uint i, s;
+
+  if(pipe(data) < 0 || pipe(back) < 0){
+    printf(2, "shmbench: pipe failed\n");
+    exit();
+  }
+  if(fork() == 0){
+    close(data[1]);
+    close(back[0]);
+    s = have = 0;
+    while((n = read(data[0], (char*)buf + have, nword*4 - have)) > 0){
+      have += n;
+      if(have == nword*4){
+        s += sum(buf);
+        have = 0;
+      }
+    }
+    write(back[1], &s, sizeof(s));
+    exit();
+  }
+  close(data[0]);
+  close(back[1]);
+  for(i = 0; i < nchunk; i++){
+    fill(buf, i);
+    if(write(data[1], buf, nword*4) != nword*4){
+      printf(2, "shmbench: write failed\n");
+      break;
+    }
+  }
+  close(data[1]);
+  s = 0;
+  read(back[0], &s, sizeof(s));
+  close(back[0]);
+  wait();
+  return s;
+}
+
+// Send the chunks through a ring in a shared memory segment,
+// which the consumer inherits attached.
+uint
+viashm(void)
+{
+  struct ring *r;
+  uint *slot, i, s;
+  int id;
+
+  if((id = shmget(getpid(), PG + NSLOT*nword*4)) < 0 ||
+     (r = shmat(id)) == (struct ring*)-1){
+    printf(2, "shmbench: no shared memory\n");
+    exit();
+  }
+  slot = (uint*)((char*)r + PG);
+  if(fork() == 0){
+    for(i = 0; i < nchunk; i++){
+      mutex_lock(&r->m);
+      while(r->head == r->tail)
+        cond_wait(&r->nonempty, &r->m);
+      mutex_unlock(&r->m);
+      s = sum(slot + (i % NSLOT)*nword);
+      mutex_lock(&r->m);
+      r->sum += s;
+      r->tail++;
+      cond_signal(&r->nonfull);
+      mutex_unlock(&r->m);
+    }
+    exit();
+  }
+  for(i = 0; i < nchunk; i++){
+    mutex_lock(&r->m);
+    while(r->head - r->tail == NSLOT)
+      cond_wait(&r->nonfull, &r->m);
+    mutex_unlock(&r->m);
+    fill(slot + (i % NSLOT)*nword, i);
+    mutex_lock(&r->m);
+    r->head++;
+    cond_signal(&r->nonempty);
+    mutex_unlock(&r->m);
+  }
+  wait();
+  s = r->sum;
+  shmdt(r);
+  return s;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, kb;
+  uint n, want, t0, got;
+  uint *buf;
+
+  mb = argc > 1 ? atoi(argv[1]) : 64;
+  kb = argc > 2 ? atoi(argv[2]) : 64;
+  if(mb < 1 || kb < 1 || kb > 256 || (mb*1024) % kb != 0){
+    printf(2, "usage: shmbench [mb [kb (1-256, dividing mb)]]\n");
+    exit();
+  }
+  nword = kb * 1024 / 4;
+  nchunk = mb * 1024 / kb;
+  n = nchunk * nword;
+  want = n % 2 == 0 ? (n/2) * (n-1) : n * ((n-1)/2);
+  if((buf = malloc(nword*4)) == 0){
+    printf(2, "shmbench: out of memory\n");
+    exit();
+  }
+
+  t0 = usecs();
+  got = viapipe(buf);
+  report("pipe", mb, t0, got, want);
+
+  t0 = usecs();
+  got = viashm();
+  report("shm", mb, t0, got, want);
+  exit();
+}
@@ -0,0 +1,221 @@
+// Object caches: allocation of small kernel objects of one
+// size, such as pipes, files, inodes and buffers, packed many
+// to a page (a slab) instead of a page or a static table slot
+// each.
+//
+// Each cache keeps its slabs on three lists, by whether they
+// have free objects left: partial, full and empty.  It keeps
+// one empty slab for the next allocation and gives further
+// empty ones back to kalloc.
+//
+// In front of the slabs, each CPU has a magazine of up to
+// MAGSIZE free objects of each cache.  Allocations and frees
+// go to the current CPU's magazine, and take the cache's lock
+// only to move MAGSIZE/2 objects between a magazine that ran
+// empty or full and the slabs.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+
+#define NCACHE  8
+#define MAGSIZE 16
+
+// At the start of each slab page.
+struct slab {
+  struct slab *next;
+  struct slab *prev;
+  struct kmem_cache *cache;
+  void *free;              // free objects, linked through their first word
+  int inuse;
+};
+
+struct magazine {
+  struct spinlock lock;
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+  char *name;
+  uint size;
+  uint nper;               // objects per slab
+  struct spinlock lock;    // protects the lists and slabs
+  struct slab *partial;
+  struct slab *full;
+  struct slab *empty;
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache cache[NCACHE];
+} slabs;
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+// Create a cache of objects of size bytes.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+  int i;
+
+  if(size < sizeof(void*))
+    size = sizeof(void*);
+  size = (size + 3) & ~3;
+  if(size > PGSIZE - sizeof(struct slab))
+    panic("kmem_cache_create: too big");
+
+  acquire(&slabs.lock);
+  for(c = slabs.cache; c < &slabs.cache[NCACHE]; c++)
+    if(c->name == 0)
+      break;
+  if(c == &slabs.cache[NCACHE])
+    panic("kmem_cache_create: too many");
+  c->name = name;
+  release(&slabs.lock);
+
+  c->size = size;
+  c->nper = (PGSIZE - sizeof(struct slab)) / size;
+  initlock(&c->lock, name);
+  for(i = 0; i < NCPU; i++)
+    initlock(&c->mag[i].lock, name);
+  return c;
+}
+
+//PAGEBREAK!
+// Slab lists.  Caller must hold c->lock.
+
+static void
+slabpush(struct slab **list, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *list;
+  if(s->next)
+    s->next->prev = s;
+  *list = s;
+}
+
+static void
+slabremove(struct slab **list, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Take a free object from the slabs, growing the cache by a
+// slab if none has any.  Returns 0 if out of memory.
+static void*
+slaballoc(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *p;
+  void *obj;
+  int i;
+
+  if((s = c->partial) != 0)
+    slabremove(&c->partial, s);
+  else if((s = c->empty) != 0)
+    slabremove(&c->empty, s);
+  else {
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->inuse = 0;
+    s->free = 0;
+    p = (char*)(s + 1);
+    for(i = 0; i < c->nper; i++, p += c->size){
+      *(void**)p = s->free;
+      s->free = p;
+    }
+  }
+
+  obj = s->free;
+  s->free = *(void**)obj;
+  s->inuse++;
+  slabpush(s->free ? &c->partial : &c->full, s);
+  return obj;
+}
+
+// Return obj to its slab.
+static void
+slabfree(struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+  slabremove(s->free ? &c->partial : &c->full, s);
+  *(void**)obj = s->free;
+  s->free = obj;
+  s->inuse--;
+  if(s->inuse > 0)
+    slabpush(&c->partial, s);
+  else if(c->empty == 0)
+    slabpush(&c->empty, s);
+  else
+    kfree((char*)s);
+}
+
+//PAGEBREAK!
+// Lock and return the current CPU's magazine for c.
+static struct magazine*
+mymag(struct kmem_cache *c)
+{
+  struct magazine *m;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  acquire(&m->lock);
+  popcli();
+  return m;
+}
+
+// Allocate an object from c.  Its content is left over
+// from its last use.  Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  m = mymag(c);
+  if(m->n == 0){
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slaballoc(c)) != 0)
+      m->obj[m->n++] = obj;
+    release(&c->lock);
+  }
+  obj = m->n > 0 ? m->obj[--m->n] : 0;
+  release(&m->lock);
+  return obj;
+}
+
+// Free obj, allocated from c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  m = mymag(c);
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slabfree(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  release(&m->lock);
+}
@@ -0,0 +1,108 @@
+// sleepbench: cost of many sleeping processes.
+//   sleepbench [nsleep [ticks]]
+// Times a fixed amount of CPU work alone, then again while
+// nsleep processes (default 60) sleep ticks ticks (default 20)
+// at a time.  Sleepers should not slow the work down, should
+// be scheduled about once per sleep, and should not oversleep
+// by more than a tick.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pstat.h"
+
+#define ROUNDS 10
+#define WORK   400
+
+struct result {
+  uint maxlate;   // worst oversleep, us
+  uint nswitch;   // times scheduled
+};
+
+struct pstat ps[NPROC];
+
+uint
+work(void)
+{
+  volatile int x;
+  uint t0;
+  int i, j;
+
+  t0 = usecs();
+  x = 0;
+  for(i = 0; i < WORK; i++)
+    for(j = 0; j < 100000; j++)
+      x += j;
+  return (usecs() - t0) / 1000;
+}
+
+void
+sleeper(int ticks, int fd)
+{
+  struct result r;
+  uint t0, late;
+  int i, n;
+
+  r.maxlate = 0;
+  for(i = 0; i < ROUNDS; i++){
+    t0 = usecs();
+    sleep(ticks);
+    late = usecs() - t0 - ticks*(1000000/HZ);
+    if((int)late > 0 && late > r.maxlate)
+      r.maxlate = late;
+  }
+  r.nswitch = 0;
+  n = getprocs(ps, NPROC);
+  for(i = 0; i < n; i++)
+    if(ps[i].pid == getpid())
+      r.nswitch = ps[i].nswitch;
+  write(fd, &r, sizeof(r));
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct result r;
+  int nsleep, ticks, i, n, fd[2];
+  uint talone, tbusy, maxlate, nswitch;
+
+  nsleep = argc > 1 ? atoi(argv[1]) : 60;
+  ticks = argc > 2 ? atoi(argv[2]) : 20;
+  if(nsleep < 1 || nsleep > NPROC - 4 || ticks < 1){
+    printf(2, "usage: sleepbench [nsleep (1-%d) [ticks]]\n", NPROC - 4);
+    exit();
+  }
+  if(pipe(fd) < 0){
+    printf(2, "sleepbench: pipe failed\n");
+    exit();
+  }
+
+  talone = work();
+
+  for(i = 0; i < nsleep; i++){
+    if(fork() == 0){
+      close(fd[0]);
+      sleeper(ticks, fd[1]);
+    }
+  }
+  close(fd[1]);
+  tbusy = work();
+
+  maxlate = nswitch = 0;
+  for(n = 0; read(fd[0], &r, sizeof(r)) == sizeof(r); n++){
+    if(r.maxlate > maxlate)
+      maxlate = r.maxlate;
+    nswitch += r.nswitch;
+  }
+  for(i = 0; i < nsleep; i++)
+    wait();
+
+  printf(1, "sleepbench: work alone %d ms, with %d sleepers %d ms\n",
+    talone, nsleep, tbusy);
+  if(n > 0)
+    printf(1, "  sleepers: %d switches per %d sleeps, worst oversleep %d us\n",
+      nswitch/n, ROUNDS, maxlate);
+  exit();
+}
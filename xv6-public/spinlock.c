@@ -6,15 +6,19 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lsinit(lk);
+#endif
 }
 
 // Acquire the lock.
@@ -24,13 +28,23 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, spins;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // Take a ticket (the fetch-and-add is atomic) and wait
+  // for the holders before us to pass the lock on.
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  spins = 0;
+  if(lk->owner != ticket){
+    mycpu()->nspin++;
+    while(lk->owner != ticket){
+      spins++;
+      pause();
+    }
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -39,7 +53,9 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
-  getcallerpcs(&lk, lk->pcs);
+#ifdef LOCKSTAT
+  lsacquired(lk, spins, (uint)__builtin_return_address(0));
+#endif
 }
 
 // Release the lock.
@@ -49,7 +65,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
-  lk->pcs[0] = 0;
+#ifdef LOCKSTAT
+  lsreleased(lk);
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
@@ -59,10 +77,10 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket.  Only the holder writes owner, and
+  // an aligned 32-bit store is atomic, so a plain increment
+  // will do.
+  lk->owner++;
 
   popcli();
 }
@@ -91,7 +109,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->owner != lock->next && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -1,11 +1,36 @@
-// Mutual exclusion lock.
+// Mutual exclusion lock: a ticket lock.  Each acquirer takes
+// the next ticket and waits until owner reaches it, so CPUs
+// get the lock in the order they asked for it, and waiters
+// spin only reading owner, which changes once per release.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;            // Next ticket to hand out
+  volatile uint owner;  // Ticket now served; held if owner != next
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-  uint pcs[10];      // The call stack (an array of program counters)
-                     // that locked the lock.
+#ifdef LOCKSTAT
+  struct lockstat *stat;  // Statistics of the locks with this name
+  uint64 tacquire;        // TSC when acquired
+#endif
 };
 
+#ifdef LOCKSTAT
+#define NLOCKCALLER 4
+
+// Contention statistics of all the locks with one name,
+// kept by kernels built with LOCKSTAT (see lockstat.c).
+struct lockstat {
+  char *name;
+  uint ninit;          // locks initialized with this name
+  uint nacquire;       // acquisitions
+  uint ncontend;       // acquisitions that had to wait
+  uint64 nspin;        // spin loop iterations while waiting
+  uint64 hold;         // TSC cycles held, in all
+  uint maxhold;        // longest hold, in TSC cycles
+  struct {
+    uint pc;           // a caller of acquire
+    uint n;            // its acquisitions that had to wait
+  } caller[NLOCKCALLER];
+};
+#endif
@@ -10,3 +10,9 @@ struct stat {
   short nlink; // Number of links to file
   uint size;   // Size of file in bytes
 };
+
+// Block layout of a file, from the fragstat system call.
+struct fragstat {
+  uint nblocks;   // data blocks
+  uint nextents;  // runs of consecutive blocks
+};
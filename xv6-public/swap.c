@@ -0,0 +1,230 @@
+// Swap: paging user memory out to disk, so that programs
+// needing more memory than there is run slower instead of
+// failing.
+//
+// mkfs reserves a swap area on the root disk, of nswap pages
+// of BPP blocks each.  kswapd, a kernel thread, pages out
+// (see swapout in vm.c) when kalloc finds free memory below
+// SWAPLOW, until SWAPHIGH pages are free, and whenever kalloc
+// runs out and waits for it (swapwait).  A paged-out page's
+// PTE holds its slot in the swap area, and the page fault
+// handler reads it back in (swapin in vm.c).
+//
+// Each slot counts its references: the PTEs holding it, as
+// fork copies them, and kswapd or swapin while they use it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "buf.h"
+#include "pstat.h"
+
+#define NSWAPIO 4  // pages of swap I/O at once
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;          // first block of the swap area
+  uint nslot;          // pages it holds; 0 if there is no swap
+  uint nused;
+  uint next;           // where swapalloc looks first
+  uchar ref[NSWAP];
+  struct proc *kswapd;
+  int kicked;          // kswapd has work to do
+  int nwait;           // processes waiting in swapwait
+  uint gen;            // bumped each time kswapd tries a page
+  int stuck;           // its last try found nothing to page out
+} swap;
+
+uint npageout, npagein;
+
+// Disk buffers for swap I/O, apart from the buffer cache:
+// paging out must not need memory.
+struct buf swapbuf[NSWAPIO][BPP];
+
+static void kswapd(void);
+
+// Find the swap area on dev and start kswapd.
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+  int i, j;
+
+  initlock(&swap.lock, "swap");
+  for(i = 0; i < NSWAPIO; i++)
+    for(j = 0; j < BPP; j++)
+      initsleeplock(&swapbuf[i][j].lock, "swapbuf");
+  readsb(dev, &sb);
+  swap.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap < NSWAP ? sb.nswap : NSWAP;
+  if(swap.nslot > 0)
+    swap.kswapd = kproc("kswapd", kswapd);
+}
+
+// Allocate a swap slot, with one reference.
+// Returns -1 if swap is full.
+int
+swapalloc(void)
+{
+  uint i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.next + i) % swap.nslot;
+    if(swap.ref[s] == 0){
+      swap.ref[s] = 1;
+      swap.nused++;
+      swap.next = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Add a reference to slot.
+void
+swapdup(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0 || swap.ref[slot] == 255)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// Drop a reference to slot.
+void
+swapfree(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] == 0)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0)
+    swap.nused--;
+  release(&swap.lock);
+}
+
+//PAGEBREAK!
+// Read or write the page at mem from or to slot, in one disk
+// command (see iderwv).
+static void
+swaprw(uint slot, char *mem, int write)
+{
+  struct buf *b, *bs[BPP];
+  int i;
+
+  for(i = 0; i < BPP; i++){
+    b = bs[i] = &swapbuf[slot % NSWAPIO][i];
+    acquiresleep(&b->lock);
+    b->dev = swap.dev;
+    b->blockno = swap.start + slot*BPP + i;
+    b->flags = 0;
+    if(write){
+      memmove(b->data, mem + i*BSIZE, BSIZE);
+      b->flags = B_DIRTY;
+    }
+  }
+  iderwv(bs, BPP);
+  for(i = 0; i < BPP; i++){
+    if(!write)
+      memmove(mem + i*BSIZE, bs[i]->data, BSIZE);
+    releasesleep(&bs[i]->lock);
+  }
+}
+
+void
+swapread(uint slot, char *mem)
+{
+  swaprw(slot, mem, 0);
+  __sync_fetch_and_add(&npagein, 1);
+}
+
+void
+swapwrite(uint slot, char *mem)
+{
+  swaprw(slot, mem, 1);
+  __sync_fetch_and_add(&npageout, 1);
+}
+
+//PAGEBREAK!
+// Tell kswapd that free memory is low.  Called by kalloc.
+void
+swapkick(void)
+{
+  if(swap.nslot == 0 || swap.kicked)
+    return;
+  acquire(&swap.lock);
+  swap.kicked = 1;
+  wakeup(&swap.kicked);
+  release(&swap.lock);
+}
+
+// Wait for kswapd to page something out, for a kalloc that
+// found no free memory.  Returns 1 if it did, so that kalloc
+// should try again, 0 if it could not or the caller cannot
+// sleep: it holds a spinlock, or is kswapd itself.
+int
+swapwait(void)
+{
+  uint gen;
+  int ok;
+
+  if(swap.nslot == 0 || myproc() == 0 || myproc() == swap.kswapd)
+    return 0;
+  if((readeflags() & FL_IF) == 0 && mycpu()->ncli > 0)
+    return 0;
+  acquire(&swap.lock);
+  gen = swap.gen;
+  swap.nwait++;
+  swap.kicked = 1;
+  wakeup(&swap.kicked);
+  while(swap.gen == gen)
+    sleep(&swap.gen, &swap.lock);
+  swap.nwait--;
+  ok = !swap.stuck;
+  release(&swap.lock);
+  return ok;
+}
+
+static void
+kswapd(void)
+{
+  int n;
+
+  for(;;){
+    acquire(&swap.lock);
+    while(!swap.kicked)
+      sleep(&swap.kicked, &swap.lock);
+    swap.kicked = 0;
+    release(&swap.lock);
+
+    do {
+      n = swapout();
+      acquire(&swap.lock);
+      swap.gen++;
+      swap.stuck = n == 0;
+      wakeup(&swap.gen);
+      release(&swap.lock);
+    } while(n > 0 && (swap.nwait > 0 || kfreepages() < SWAPHIGH));
+  }
+}
+
+// Fill in the swap fields of *mi.
+void
+getswapinfo(struct meminfo *mi)
+{
+  mi->nswap = swap.nslot;
+  mi->nswapped = swap.nused;
+  mi->npageout = npageout;
+  mi->npagein = npagein;
+}
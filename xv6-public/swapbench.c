@@ -0,0 +1,60 @@
+// swapbench: a job needing more memory than there is.
+//   swapbench [mb [passes]]
+// Grows the heap by mb megabytes (default 256, more than the
+// 224 MB xv6 runs in), writes every page, then reads them all
+// back passes times (default 2), checking their content.
+// Prints the time each takes and how many pages kswapd paged
+// out and read back in meanwhile.  Without swap, or with too
+// little, it is killed or sbrk fails instead.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pstat.h"
+
+#define PG 4096
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo m0, m1;
+  int mb, passes, i, bad;
+  uint n, j, t0;
+  char *mem;
+
+  mb = argc > 1 ? atoi(argv[1]) : 256;
+  passes = argc > 2 ? atoi(argv[2]) : 2;
+  if(mb < 1 || passes < 0){
+    printf(2, "usage: swapbench [mb [passes]]\n");
+    exit();
+  }
+  n = mb * (1024*1024/PG);
+  if((mem = sbrk(n * PG)) == (char*)-1){
+    printf(2, "swapbench: sbrk %d MB failed\n", mb);
+    exit();
+  }
+
+  meminfo(&m0);
+  t0 = usecs();
+  for(j = 0; j < n; j++)
+    *(uint*)(mem + j*PG) = j;
+  meminfo(&m1);
+  printf(1, "write %d MB: %d ms, paged out %d, in %d\n", mb,
+    (usecs() - t0) / 1000, m1.npageout - m0.npageout,
+    m1.npagein - m0.npagein);
+
+  for(i = 0; i < passes; i++){
+    m0 = m1;
+    t0 = usecs();
+    bad = 0;
+    for(j = 0; j < n; j++)
+      if(*(uint*)(mem + j*PG) != j)
+        bad++;
+    meminfo(&m1);
+    printf(1, "read %d MB: %d ms, paged out %d, in %d%s\n", mb,
+      (usecs() - t0) / 1000, m1.npageout - m0.npageout,
+      m1.npagein - m0.npagein, bad ? " (WRONG)" : "");
+  }
+  exit();
+}
@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
@@ -54,21 +55,45 @@ argint(int n, int *ip)
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+// lies within the process address space, and fault the block
+// in and pin it now: system calls may use it with spinlocks
+// held, when pagefault could not sleep to read it from a file
+// or from swap.
+static int
+argbuf(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0)
+    return -1;
+  if(((uint)i >= curproc->sz || (uint)i+size > curproc->sz) &&
+     !shmvalid(curproc->pgdir, i, size))
+    return -1;
+  if(uvmpin(curproc, i, size, write) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// For a block the system call only reads.
+int
+argptr(int n, char **pp, int size)
+{
+  return argbuf(n, pp, size, 0);
+}
+
+// For a block the system call writes: its copy-on-write pages
+// are copied now, so that writing cannot fault, and it fails
+// if the block is not writable or memory ran out.
+int
+argptrw(int n, char **pp, int size)
+{
+  return argbuf(n, pp, size, 1);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
 // (There is no shared writable memory, so the string can't change
@@ -106,6 +131,24 @@ extern int sys_uptime(void);
 extern int sys_symlink(void);
 extern int sys_openSymlinkFile(void);
 extern int sys_sync(void);
+extern int sys_iostat(void);
+extern int sys_iosched(void);
+extern int sys_fragstat(void);
+extern int sys_defrag(void);
+extern int sys_setpriority(void);
+extern int sys_getprocs(void);
+extern int sys_sched_setaffinity(void);
+extern int sys_cpustat(void);
+extern int sys_clock_gettime(void);
+extern int sys_nanosleep(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_meminfo(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -132,6 +175,24 @@ static int (*syscalls[])(void) = {
 [SYS_symlink] sys_symlink,
 [SYS_openSymlinkFile] sys_openSymlinkFile,
 [SYS_sync] sys_sync,
+[SYS_iostat] sys_iostat,
+[SYS_iosched] sys_iosched,
+[SYS_fragstat] sys_fragstat,
+[SYS_defrag] sys_defrag,
+[SYS_setpriority] sys_setpriority,
+[SYS_getprocs] sys_getprocs,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_cpustat] sys_cpustat,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_meminfo] sys_meminfo,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
 };
 
 void
@@ -143,6 +204,7 @@ syscall(void)
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
+    curproc->pinlo = curproc->pinhi = 0;
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
@@ -22,4 +22,22 @@
 #define SYS_close  21
 #define SYS_symlink 22
 #define SYS_openSymlinkFile 23 //proj3
-#define SYS_sync 24 //proj3
\ No newline at end of file
+#define SYS_sync 24 //proj3
+#define SYS_iostat 25
+#define SYS_iosched 26
+#define SYS_fragstat 27
+#define SYS_defrag 28
+#define SYS_setpriority 29
+#define SYS_getprocs 30
+#define SYS_sched_setaffinity 31
+#define SYS_cpustat 32
+#define SYS_clock_gettime 33
+#define SYS_nanosleep 34
+#define SYS_clone 35
+#define SYS_join 36
+#define SYS_futex_wait 37
+#define SYS_futex_wake 38
+#define SYS_meminfo 39
+#define SYS_shmget 40
+#define SYS_shmat  41
+#define SYS_shmdt  42
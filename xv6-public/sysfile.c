@@ -9,12 +9,13 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "iostat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +27,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE || (f=myproc()->files->ofile[fd]) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -41,14 +42,17 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct files *fs = myproc()->files;
 
+  acquire(&fs->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(fs->ofile[fd] == 0){
+      fs->ofile[fd] = f;
+      release(&fs->lock);
       return fd;
     }
   }
+  release(&fs->lock);
   return -1;
 }
 
@@ -73,7 +77,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0) // argfd: 이 프로세스에 fd로 열린 파일 있는지도 확인
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptrw(1, &p, n) < 0) // argfd: 이 프로세스에 fd로 열린 파일 있는지도 확인
     return -1;
   return fileread(f, p, n);
 }
@@ -97,10 +101,18 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct files *fs = myproc()->files;
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  // Another thread may have closed fd since argfd.
+  acquire(&fs->lock);
+  if(fs->ofile[fd] != f){
+    release(&fs->lock);
+    return -1;
+  }
+  fs->ofile[fd] = 0;
+  release(&fs->lock);
   fileclose(f);
   return 0;
 }
@@ -111,7 +123,7 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argptrw(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
@@ -277,7 +289,7 @@ create(char *path, short type, short major, short minor)
     return 0; //에러
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
+  if((ip = ialloc(dp->dev, type, dp->inum)) == 0)
     panic("create: ialloc");
 
   ilock(ip);
@@ -444,8 +456,8 @@ int
 sys_chdir(void)
 {
   char *path;
-  struct inode *ip;
-  struct proc *curproc = myproc();
+  struct inode *ip, *old;
+  struct files *fs = myproc()->files;
   
   begin_op();
   if(argstr(0, &path) < 0 || (ip = namei(path, 1)) == 0){
@@ -459,9 +471,12 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(curproc->cwd);
+  acquire(&fs->lock);
+  old = fs->cwd;
+  fs->cwd = ip;
+  release(&fs->lock);
+  iput(old);
   end_op();
-  curproc->cwd = ip;
   return 0;
 }
 
@@ -496,16 +511,20 @@ sys_pipe(void)
 {
   int *fd;
   struct file *rf, *wf;
+  struct files *fs = myproc()->files;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argptrw(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+    if(fd0 >= 0){
+      acquire(&fs->lock);
+      fs->ofile[fd0] = 0;
+      release(&fs->lock);
+    }
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -652,4 +671,56 @@ int lookSymlink(char* symlinkPath, char* path, int n) {
 int sys_sync(void)
 {
   return sync();
-}
\ No newline at end of file
+}
+
+// Statistics of disk queue n.
+int
+sys_iostat(void)
+{
+  int n;
+  struct iostat *st;
+
+  if(argint(0, &n) < 0 || argptrw(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  return ioq_stat(n, st);
+}
+
+// Set the I/O scheduling policy of disk queue n,
+// returning the old one.
+int
+sys_iosched(void)
+{
+  int n, policy;
+
+  if(argint(0, &n) < 0 || argint(1, &policy) < 0)
+    return -1;
+  return ioq_setpolicy(n, policy);
+}
+
+// Block layout of the file open as fd.
+int
+sys_fragstat(void)
+{
+  struct file *f;
+  struct fragstat *st;
+
+  if(argfd(0, 0, &f) < 0 || argptrw(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  ifragstat(f->ip, st);
+  iunlock(f->ip);
+  return 0;
+}
+
+// Make the data blocks of the file open as fd contiguous.
+int
+sys_defrag(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_INODE)
+    return -1;
+  return idefrag(f->ip);
+}
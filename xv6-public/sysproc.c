@@ -5,7 +5,9 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
+#include "pstat.h"
 
 int
 sys_fork(void)
@@ -45,35 +47,100 @@ sys_getpid(void)
 int
 sys_sbrk(void)
 {
-  int addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  return growproc(n);
+}
+
+int
+sys_clone(void)
+{
+  int fn, arg;
+  char *stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 ||
+     argptr(2, &stack, PGSIZE) < 0)
+    return -1;
+  return clone((void(*)(void*))fn, (void*)arg, stack);
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
+int
+sys_join(void)
+{
+  void **stack;
+
+  if(argptrw(0, (void*)&stack, sizeof(*stack)) < 0)
     return -1;
-  return addr;
+  return join(stack);
 }
 
 int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
+  if(n <= 0)
+    return 0;
+  return sleepticks(n);
+}
+
+// Sleep for the struct timespec at argument 0, on the timer
+// wheel like sys_sleep, so to the resolution of a tick: the
+// time is rounded up to whole ticks, plus one, since the next
+// tick may come at once.  It sleeps at least as long as asked,
+// and at most two ticks longer.
+int
+sys_nanosleep(void)
+{
+  struct timespec *ts;
+  uint64 ns, n;
+
+  if(argptr(0, (void*)&ts, sizeof(*ts)) < 0 || ts->nsec >= 1000000000)
+    return -1;
+  ns = (uint64)ts->sec * 1000000000 + ts->nsec;
+  if(ns == 0)
+    return 0;
+  n = div64(ns + 1000000000/HZ - 1, 1000000000/HZ, 0) + 1;
+  if(n > 0x40000000)
+    n = 0x40000000;  // months; deadlines must stay in 31 bits
+  return sleepticks(n);
+}
+
+// Time since boot, to the nanosecond.
+int
+sys_clock_gettime(void)
+{
+  struct timespec *ts;
+  uint rem;
+
+  if(argptrw(0, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  ts->sec = div64(nsecs(), 1000000000, &rem);
+  ts->nsec = rem;
   return 0;
 }
 
@@ -89,3 +156,100 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+int
+sys_setpriority(void)
+{
+  int pid, level;
+
+  if(argint(0, &pid) < 0 || argint(1, &level) < 0)
+    return -1;
+  return setpriority(pid, level);
+}
+
+// Copy statistics of up to n processes to the user's array.
+int
+sys_getprocs(void)
+{
+  struct pstat *ps;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0 || n > NPROC ||
+     argptrw(0, (void*)&ps, n*sizeof(*ps)) < 0)
+    return -1;
+  return getprocs(ps, n);
+}
+
+int
+sys_cpustat(void)
+{
+  struct cpustat *cs;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0 || n > NCPU ||
+     argptrw(0, (void*)&cs, n*sizeof(*cs)) < 0)
+    return -1;
+  return getcpustats(cs, n);
+}
+
+int
+sys_meminfo(void)
+{
+  struct meminfo *mi, m;
+
+  if(argptrw(0, (void*)&mi, sizeof(*mi)) < 0)
+    return -1;
+  // Not straight into *mi: writing user memory may need a
+  // page, and getmeminfo holds the allocator's locks.
+  getmeminfo(&m);
+  getswapinfo(&m);
+  *mi = m;
+  return 0;
+}
+
+int
+sys_shmget(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmget(key, size);
+}
+
+int
+sys_shmat(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmat(id);
+}
+
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmdt(addr);
+}
+
+// Restrict a process (0: the caller) to a set of CPUs.
+int
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+  struct proc *p = myproc();
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  if(setaffinity(pid, mask) < 0)
+    return -1;
+  // Leave a CPU we may no longer use.
+  if((pid == 0 || pid == p->pid) && !(p->affinity & (1 << p->cpu)))
+    yield();
+  return 0;
+}
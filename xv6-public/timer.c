@@ -0,0 +1,231 @@
+// High-resolution time from the processor's time-stamp counter.
+// The TSC counts at a constant rate unknown to xv6, so timerinit
+// measures it against the 8253 programmable interval timer (PIT),
+// whose input clock runs at a fixed 1193182 Hz.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define PIT_HZ    1193182
+#define PIT_CH2   0x42      // channel 2 counter
+#define PIT_MODE  0x43      // mode register
+#define PIT_GATE  0x61      // channel 2 gate (bit 0), output (bit 5)
+
+uint tsckhz;                // TSC counts per millisecond
+static uint64 tscboot;      // TSC when timerinit ran
+
+// Busy-wait ms milliseconds (at most 54) on PIT channel 2,
+// which counts down once and raises its output at zero.
+// Channel 2 drives only the speaker, which stays off.
+void
+pitwait(uint ms)
+{
+  uint n = PIT_HZ / 1000 * ms;
+
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);
+  outb(PIT_MODE, 0xB0);     // channel 2, low then high byte, mode 0
+  outb(PIT_CH2, n);
+  outb(PIT_CH2, n >> 8);
+  while((inb(PIT_GATE) & 0x20) == 0)
+    ;
+}
+
+// Divide n by d, with the remainder in *rem if rem is not 0.
+// The kernel has no libgcc, so 64-bit division is done with
+// two 32-bit divl instructions.
+uint64
+div64(uint64 n, uint d, uint *rem)
+{
+  uint hi, lo, qhi, qlo, r;
+
+  hi = n >> 32;
+  lo = n;
+  qhi = hi / d;
+  hi = hi % d;
+  asm("divl %4" : "=a" (qlo), "=d" (r) : "a" (lo), "d" (hi), "rm" (d));
+  if(rem)
+    *rem = r;
+  return ((uint64)qhi << 32) | qlo;
+}
+
+void
+timerinit(void)
+{
+  uint64 t0;
+
+  t0 = rdtsc();
+  pitwait(10);
+  tscboot = rdtsc();
+  tsckhz = div64(tscboot - t0, 10, 0);
+}
+
+// Nanoseconds since timerinit.
+uint64
+nsecs(void)
+{
+  uint64 ms;
+  uint rem;
+
+  ms = div64(rdtsc() - tscboot, tsckhz, &rem);
+  return ms * 1000000 + div64((uint64)rem * 1000000, tsckhz, 0);
+}
+
+// Microseconds since timerinit, truncated to 32 bits: it wraps
+// after about 71 minutes, so use it only for intervals.
+uint
+usecs(void)
+{
+  return div64(nsecs(), 1000, 0);
+}
+
+//PAGEBREAK!
+// Sleeping processes wait on a hierarchical timer wheel, so
+// that each is woken once, at its own deadline, rather than
+// on every tick.  Level 0 has a slot for each of the next
+// WSIZE ticks; each slot of level l covers WSIZE^l ticks.
+// When level 0 wraps around, the next slot of level 1 is
+// cascaded: its processes move down to the level-0 slot of
+// their deadline, and likewise for higher levels.  Adding,
+// removing and expiring a timer take constant time; cascading
+// moves each timer at most NWHEEL-1 times.
+// The wheel is guarded by tickslock.
+#define WBITS   6
+#define WSIZE   (1 << WBITS)
+#define WMASK   (WSIZE - 1)
+#define NWHEEL  3
+
+static struct proc *wheel[NWHEEL][WSIZE];
+static uint wnext;          // next tick the wheel will run
+
+// Put p on the slot for p->wakeat.
+static void
+twadd(struct proc *p)
+{
+  uint e, d;
+  int l;
+
+  e = p->wakeat;
+  d = e - wnext;
+  if((int)d < 0)
+    e = wnext;               // overdue: fire on the next run
+  else if(d >= 1 << (WBITS*NWHEEL))
+    e = wnext + (1 << (WBITS*NWHEEL)) - 1;  // re-added when cascaded
+  d = e - wnext;
+  for(l = 0; l < NWHEEL-1; l++)
+    if(d < 1 << (WBITS*(l+1)))
+      break;
+  p->tlink = &wheel[l][(e >> (WBITS*l)) & WMASK];
+  p->tnext = *p->tlink;
+  if(p->tnext)
+    p->tnext->tlink = &p->tnext;
+  *p->tlink = p;
+}
+
+// Take p off its slot.
+static void
+twdel(struct proc *p)
+{
+  *p->tlink = p->tnext;
+  if(p->tnext)
+    p->tnext->tlink = p->tlink;
+  p->tlink = 0;
+  p->tnext = 0;
+}
+
+// Re-add the timers of slot i of level l, one level down.
+// Returns i, so callers know whether level l wrapped too.
+static int
+cascade(int l, int i)
+{
+  struct proc *p, *next;
+
+  p = wheel[l][i];
+  wheel[l][i] = 0;
+  for(; p; p = next){
+    next = p->tnext;
+    twadd(p);
+  }
+  return i;
+}
+
+// Run the wheel through tick now: wake every process whose
+// deadline has come.  Called by addticks with tickslock held.
+void
+runtimers(uint now)
+{
+  struct proc *p;
+  int i, l;
+
+  while((int)(now - wnext) >= 0){
+    i = wnext & WMASK;
+    for(l = 1; l < NWHEEL && i == 0; l++)
+      i = cascade(l, (wnext >> (WBITS*l)) & WMASK);
+    i = wnext & WMASK;
+    while((p = wheel[0][i]) != 0){
+      twdel(p);
+      wakeup(&p->wakeat);
+    }
+    wnext++;
+  }
+}
+
+// Will running the wheel at tick t fire or cascade a timer?
+static int
+due(uint t)
+{
+  int l;
+
+  if(wheel[0][t & WMASK])
+    return 1;
+  for(l = 1; l < NWHEEL && ((t >> (WBITS*(l-1))) & WMASK) == 0; l++)
+    if(wheel[l][(t >> (WBITS*l)) & WMASK])
+      return 1;
+  return 0;
+}
+
+// Ticks from now until the wheel next has work to do, but at
+// most max.  CPU 0 can stop its tick for that long.
+uint
+timernext(uint max)
+{
+  uint t, n;
+
+  acquire(&tickslock);
+  for(t = wnext; t - wnext < max && !due(t); t++)
+    ;
+  n = t - ticks;
+  release(&tickslock);
+  if(n == 0)
+    n = 1;
+  return n > max ? max : n;
+}
+
+// Sleep for n ticks.  Returns -1 if killed meanwhile.
+int
+sleepticks(uint n)
+{
+  struct proc *p = myproc();
+  int r;
+
+  if(n == 0)
+    return 0;
+  r = 0;
+  acquire(&tickslock);
+  p->wakeat = ticks + n;
+  twadd(p);
+  while(p->tlink){
+    if(p->killed){
+      twdel(p);
+      r = -1;
+      break;
+    }
+    sleep(&p->wakeat, &tickslock);
+  }
+  release(&tickslock);
+  return r;
+}
@@ -0,0 +1,33 @@
+// top: show processes with their scheduling statistics.
+//   top [count]
+// Prints the process table count times (default once),
+// a second apart.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "pstat.h"
+
+struct pstat ps[NPROC];
+
+int
+main(int argc, char *argv[])
+{
+  int count, i, n;
+
+  count = argc > 1 ? atoi(argv[1]) : 1;
+  while(count-- > 0){
+    n = getprocs(ps, NPROC);
+    printf(1, "pid\tstate\tlevel\tcpu\tsize\trtime\twtime\tswitch\tmigrate\tname\n");
+    for(i = 0; i < n; i++)
+      printf(1, "%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\n", ps[i].pid,
+        ps[i].state, ps[i].level, ps[i].cpu, ps[i].sz, ps[i].rtime,
+        ps[i].wtime, ps[i].nswitch, ps[i].nmigrate, ps[i].name);
+    if(count > 0){
+      sleep(100);
+      printf(1, "\n");
+    }
+  }
+  exit();
+}
@@ -3,10 +3,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -14,6 +14,21 @@ extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
 
+// Advance the clock by n ticks.  Only CPU 0 keeps time.
+void
+addticks(uint n)
+{
+  uint t;
+
+  acquire(&tickslock);
+  t = ticks;
+  ticks += n;
+  runtimers(ticks);
+  release(&tickslock);
+  if(t / BOOSTTICKS != (t + n) / BOOSTTICKS)
+    boost();
+}
+
 void
 tvinit(void)
 {
@@ -48,20 +63,23 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    if(cpuid() == 0)
+      addticks(1);
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_WAKE:
+    // Nothing to do: the interrupt got the CPU out of hlt.
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
-    ideintr();
+    ideintr(0);
     lapiceoi();
     break;
-  case T_IRQ0 + IRQ_IDE+1:
-    // Bochs generates spurious IDE1 interrupts.
+  case T_IRQ0 + IRQ_IDE2:
+    // Bochs generates spurious IDE1 interrupts;
+    // ideintr ignores them when nothing is queued.
+    ideintr(1);
+    lapiceoi();
     break;
   case T_IRQ0 + IRQ_KBD:
     kbdintr();
@@ -78,6 +96,15 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // Touching a page not yet read from the program file or
+    // allocated for the heap, or writing a copy-on-write page,
+    // from user space or from the kernel using user memory, is
+    // fixed up by pagefault.  Anything else is a real fault.
+    if(myproc() && pagefault(myproc(), rcr2(), tf->err & FEC_WR) == 0)
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -103,7 +130,7 @@ trap(struct trapframe *tf)
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     tf->trapno == T_IRQ0+IRQ_TIMER && schedtick())
     yield();
 
   // Check if the process has been killed since we yielded
@@ -33,6 +33,8 @@
 #define IRQ_KBD          1
 #define IRQ_COM1         4
 #define IRQ_IDE         14
+#define IRQ_IDE2        15
 #define IRQ_ERROR       19
+#define IRQ_WAKE        28   // IPI: wake an idle CPU
 #define IRQ_SPURIOUS    31
 
@@ -1,6 +1,7 @@
 #include "types.h"
 #include "stat.h"
 #include "fcntl.h"
+#include "date.h"
 #include "user.h"
 #include "x86.h"
 
@@ -104,3 +105,78 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Microseconds since boot.  Wraps after about 71 minutes, so
+// use it only to time intervals.
+uint
+usecs(void)
+{
+  struct timespec ts;
+
+  if(clock_gettime(&ts) < 0)
+    return 0;
+  return ts.sec*1000000 + ts.nsec/1000;
+}
+
+// Mutexes after Drepper, "Futexes Are Tricky".  Locking and
+// unlocking an uncontended mutex are single atomic
+// instructions; only a thread that must wait, or one that
+// unlocks a mutex others wait for, makes a system call.
+void
+mutex_lock(struct mutex *m)
+{
+  uint c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  // Announce a waiter, and sleep until the holder unlocks.
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futex_wake(&m->state, 1);
+}
+
+// Wait for cond to be signalled, with m locked.  Like any
+// condition variable, it may return without a signal, so
+// callers must recheck their condition.
+void
+cond_wait(struct cond *cv, struct mutex *m)
+{
+  uint seq;
+
+  __sync_fetch_and_add(&cv->nwait, 1);
+  seq = cv->seq;
+  mutex_unlock(m);
+  futex_wait(&cv->seq, seq);
+  __sync_fetch_and_sub(&cv->nwait, 1);
+  // Others may be waiting for m too: lock it as contended.
+  while(xchg(&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+// Wake one waiter.  Call with the waiters' mutex held, so
+// that a thread about to wait is not missed.
+void
+cond_signal(struct cond *cv)
+{
+  __sync_fetch_and_add(&cv->seq, 1);
+  if(cv->nwait > 0)
+    futex_wake(&cv->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *cv)
+{
+  __sync_fetch_and_add(&cv->seq, 1);
+  if(cv->nwait > 0)
+    futex_wake(&cv->seq, cv->nwait);
+}
@@ -1,5 +1,22 @@
 struct stat;
 struct rtcdate;
+struct iostat;
+struct fragstat;
+struct pstat;
+struct cpustat;
+struct meminfo;
+struct timespec;
+
+// Locks for threads, built on futexes (see ulib.c).
+// All zeroes is an unlocked mutex or a fresh condition.
+struct mutex {
+  uint state;   // 0: unlocked, 1: locked, 2: locked and maybe waited on
+};
+
+struct cond {
+  uint seq;     // bumped by each signal
+  uint nwait;   // threads waiting
+};
 
 // system calls
 int fork(void);
@@ -38,7 +55,36 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+uint usecs(void);
+
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+
+// uthread.c
+int thread_create(void(*)(void*), void*);
+int thread_join(void);
 
 //proj3
 int symlink(char*, char*);
-int sync(void);
\ No newline at end of file
+int sync(void);
+int iostat(int, struct iostat*);
+int iosched(int, int);
+int fragstat(int, struct fragstat*);
+int defrag(int);
+int setpriority(int, int);
+int getprocs(struct pstat*, int);
+int sched_setaffinity(int, uint);
+int cpustat(struct cpustat*, int);
+int clock_gettime(struct timespec*);
+int nanosleep(struct timespec*);
+int clone(void(*)(void*), void*, void*);
+int join(void**);
+int futex_wait(uint*, uint);
+int futex_wake(uint*, int);
+int meminfo(struct meminfo*);
+int shmget(int, uint);
+void* shmat(int);
+int shmdt(void*);
@@ -0,0 +1,34 @@
+// Threads: clone and join with stacks from malloc.
+
+#include "types.h"
+#include "user.h"
+#include "mmu.h"
+
+// Start a thread running fn(arg) on a fresh one-page stack.
+// fn must end with exit().  Returns the thread's pid.
+// malloc is not thread-safe: call this from one thread only.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  void *stack;
+  int pid;
+
+  if((stack = malloc(PGSIZE)) == 0)
+    return -1;
+  if((pid = clone(fn, arg, stack)) < 0)
+    free(stack);
+  return pid;
+}
+
+// Wait for a thread to exit and free its stack.
+// Returns its pid, or -1 if there are no threads.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(stack);
+  return pid;
+}
@@ -4,11 +4,21 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "elf.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
+struct spinlock faultlock;  // guards uvmfault, and user PTEs from kswapd
+
+// A paged-out page's PTE holds its swap slot in place of the
+// physical address, PTE_SWAP, and its PTE_W and PTE_U.
+#define SWAPPTE(slot, pte) (((slot) << 12) | PTE_SWAP | ((pte) & (PTE_W|PTE_U)))
+#define SWAPSLOT(pte)      ((uint)(pte) >> 12)
+
+static int pageout = -1;  // slot kswapd is writing; guarded by faultlock
+static int swapin(pde_t*, uint);
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -42,10 +52,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -101,7 +110,10 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 // (directly addressable from end..P2V(PHYSTOP)).
 
 // This table defines the kernel's mappings, which are present in
-// every process's page table.
+// every process's page table.  kvmalloc builds them once, in
+// kpgdir, and every page table shares kpgdir's page-table pages
+// for them.  They are global, so switching page tables does not
+// flush them from the TLB.
 static struct kmap {
   void *virt;
   uint phys_start;
@@ -114,34 +126,38 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Set up kernel part of a page table, by copying kpgdir's
+// entries above KERNBASE.
 pde_t*
 setupkvm(void)
 {
   pde_t *pgdir;
-  struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes, and the page-table pages for
+// the kernel's mappings that all page tables share.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if((kpgdir = (pde_t*)kalloc_zeroed()) == 0)
+    panic("kvmalloc");
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(mappages(kpgdir, k->virt, k->phys_end - k->phys_start,
+                (uint)k->phys_start, k->perm | PTE_G) < 0)
+      panic("kvmalloc");
   switchkvm();
+  initlock(&faultlock, "fault");
 }
 
 // Switch h/w page table register to the kernel-only page table,
@@ -186,36 +202,11 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -224,20 +215,19 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz >= SHMBASE)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -252,6 +242,8 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
 // process size.  Returns the new process size.
+// Holds faultlock, so that once freevm has called it, kswapd
+// no longer uses pgdir (see uservm).
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
@@ -261,6 +253,7 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   if(newsz >= oldsz)
     return oldsz;
 
+  acquire(&faultlock);
   a = PGROUNDUP(newsz);
   for(; a  < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
@@ -273,13 +266,18 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       char *v = P2V(pa);
       kfree(v);
       *pte = 0;
+    } else if((*pte & PTE_SWAP) != 0){
+      swapfree(SWAPSLOT(*pte));
+      *pte = 0;
     }
   }
+  release(&faultlock);
   return newsz;
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The kernel part's page-table pages are
+// kpgdir's, and stay.
 void
 freevm(pde_t *pgdir)
 {
@@ -287,8 +285,9 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+  shmdrop(pgdir);
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
+  for(i = 0; i < PDX(KERNBASE); i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
@@ -297,6 +296,29 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
+// Map the n pages page[] at va in pgdir, writable, sharing
+// them with whoever else maps them: each mapping takes a
+// reference to its page.  Returns 0, or -1 with none of them
+// mapped if out of memory.
+int
+shareuvm(pde_t *pgdir, uint va, char **page, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    // Reference first: kswapd must not take the page once
+    // it is mapped.
+    kref(page[i]);
+    if(mappages(pgdir, (char*)va + i*PGSIZE, PGSIZE, V2P(page[i]),
+                PTE_W|PTE_U) < 0){
+      kfree(page[i]);
+      deallocuvm(pgdir, va + i*PGSIZE, va);
+      return -1;
+    }
+  }
+  return 0;
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
@@ -311,39 +333,424 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  If cow is set, the child shares the
+// parent's pages instead of copying them: writable pages
+// become read-only and PTE_COW in both, and uvmfault copies
+// a page when either first writes it.  Sharing needs the
+// parent's TLB to be flushed, so pgdir must be either the
+// current page table or not in use at all.
+// Paged-out pages share their swap slot; each process reads
+// its own copy back in.  Shared memory segments stay shared.
 pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+copyuvm(pde_t *pgdir, uint sz, int cow)
 {
   pde_t *d;
   pte_t *pte;
-  uint pa, i, flags;
+  uint pa, i, e;
   char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
+    // kswapd may page the parent's pages out meanwhile, so
+    // take a reference to the page or slot under faultlock.
+    acquire(&faultlock);
+    // Heap pages not yet touched stay that way in the child.
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0){
+      release(&faultlock);
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if(cow && (*pte & (PTE_P|PTE_W)) == (PTE_P|PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+    e = *pte;
+    if(e & PTE_P)
+      kref(P2V(PTE_ADDR(e)));
+    else if(e & PTE_SWAP)
+      swapdup(SWAPSLOT(e));
+    release(&faultlock);
+
+    if(e & PTE_SWAP){
+      if((pte = walkpgdir(d, (void*)i, 1)) == 0){
+        swapfree(SWAPSLOT(e));
+        goto bad;
+      }
+      *pte = e;
+      continue;
+    }
+    if(!(e & PTE_P))
+      continue;
+    pa = PTE_ADDR(e);
+    if(!cow){
+      if((mem = kalloc()) != 0)
+        memmove(mem, (char*)P2V(pa), PGSIZE);
+      kfree(P2V(pa));
+      if(mem == 0)
+        goto bad;
+      pa = V2P(mem);
+    }
+    if(mappages(d, (void*)i, PGSIZE, pa, PTE_FLAGS(e)) < 0){
+      kfree(P2V(pa));
       goto bad;
     }
   }
+  if(shmcopy(pgdir, d) < 0)
+    goto bad;
+  if(cow && rcr3() == V2P(pgdir))
+    lcr3(V2P(pgdir));
   return d;
 
 bad:
+  if(cow && rcr3() == V2P(pgdir))
+    lcr3(V2P(pgdir));
   freevm(d);
   return 0;
 }
 
+// Handle a fault on user address va of a process of size sz
+// with page table pgdir.  A page of the heap that sbrk only
+// reserved (see growproc) gets a zeroed page on first touch;
+// a paged-out page is read back in from swap; a write to a
+// copy-on-write page gets a writable page of its own, a copy
+// of the shared one unless nobody else uses it any more.
+// Returns 0 if the access can be retried, -1 if it is not
+// allowed or memory ran out.
+int
+uvmfault(pde_t *pgdir, uint sz, uint va, int write)
+{
+  pte_t *pte;
+  char *old, *mem;
+  int r;
+
+  if(va >= KERNBASE)
+    return -1;
+  va = PGROUNDDOWN(va);
+again:
+  acquire(&faultlock);
+  r = -1;
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_SWAP)){
+    release(&faultlock);
+    if(swapin(pgdir, va) < 0)
+      return -1;
+    goto again;
+  }
+  if(pte == 0 || (*pte & PTE_P) == 0){
+    if(va >= sz)
+      goto out;
+    if((mem = kalloc_zeroed()) == 0)
+      goto nomem;
+    if(mappages(pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+      kfree(mem);
+      goto nomem;
+    }
+    r = 0;
+    goto out;
+  }
+  if((*pte & PTE_U) == 0)
+    goto out;
+  if(!write || (*pte & PTE_W)){
+    r = 0;  // another thread of pgdir got here first
+    goto out;
+  }
+  if(!(*pte & PTE_COW))
+    goto out;
+  old = P2V(PTE_ADDR(*pte));
+  if(krefs(old) == 1){
+    *pte = (*pte | PTE_W) & ~PTE_COW;
+  } else {
+    if((mem = kalloc()) == 0)
+      goto nomem;
+    memmove(mem, old, PGSIZE);
+    *pte = V2P(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW);
+    kfree(old);
+  }
+  r = 0;
+out:
+  if(r == 0 && rcr3() == V2P(pgdir))
+    invlpg((char*)va);
+  release(&faultlock);
+  return r;
+
+nomem:
+  // kalloc cannot wait for kswapd with faultlock held.
+  release(&faultlock);
+  if(swapwait())
+    goto again;
+  return -1;
+}
+
+// Read the paged-out page at va of pgdir back in from swap.
+// Returns 0 if the access can be retried, -1 if memory ran
+// out.  Reading may sleep, so no spinlocks may be held.
+static int
+swapin(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  uint e, slot;
+  char *mem;
+
+  if((readeflags() & FL_IF) == 0 && mycpu()->ncli > 0)
+    panic("swapin: spinlock held");
+  if((mem = kalloc()) == 0)
+    return -1;
+  acquire(&faultlock);
+  for(;;){
+    pte = walkpgdir(pgdir, (char*)va, 0);
+    if(pte == 0 || (*pte & PTE_SWAP) == 0){
+      // Another thread read it in first.
+      release(&faultlock);
+      kfree(mem);
+      return 0;
+    }
+    e = *pte;
+    if((int)SWAPSLOT(e) != pageout)
+      break;
+    sleep(&pageout, &faultlock);  // still being written
+  }
+  slot = SWAPSLOT(e);
+  swapdup(slot);  // keep it while reading
+  release(&faultlock);
+
+  swapread(slot, mem);
+
+  acquire(&faultlock);
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte && *pte == e){
+    *pte = V2P(mem) | (e & (PTE_W|PTE_U)) | PTE_P;
+    swapfree(slot);
+    mem = 0;
+  }
+  swapfree(slot);
+  release(&faultlock);
+  if(mem)
+    kfree(mem);
+  return 0;
+}
+
+// Handle a fault on user address va by p.  Pages of p's
+// program file are read in when first touched, through the
+// page cache: a page wholly from the file is the cached one,
+// shared read-only, or copy-on-write if its segment is
+// writable, except that threads get a copy of their own
+// (see uncow).  Everything else is up to uvmfault.  Returns 0
+// if the access can be retried, -1 if not.
+// Reading the file may sleep, so the kernel must not touch
+// user memory with spinlocks held unless the pages are known
+// to be present (see argptr).
+int
+pagefault(struct proc *p, uint va, int write)
+{
+  struct seg *s;
+  pte_t *pte;
+  char *mem, *cached;
+  uint off, n, flags;
+
+  va = PGROUNDDOWN(va);
+  if(va >= p->sz || p->exe == 0)
+    return uvmfault(p->pgdir, p->sz, va, write);
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & (PTE_P|PTE_SWAP))){
+    if(!write && (*pte & (PTE_P|PTE_U)) == (PTE_P|PTE_U))
+      return 0;
+    return uvmfault(p->pgdir, p->sz, va, write);
+  }
+  for(s = p->seg; s < &p->seg[NSEG]; s++)
+    if(va >= s->va && va < s->va + s->filesz)
+      break;
+  if(s == &p->seg[NSEG])
+    return uvmfault(p->pgdir, p->sz, va, write);
+
+  if((readeflags() & FL_IF) == 0 && mycpu()->ncli > 0)
+    panic("pagefault: spinlock held");
+  off = s->off + (va - s->va);
+  n = s->va + s->filesz - va;
+  if(n >= PGSIZE){
+    if((mem = pcget(p->exe, off)) == 0)
+      return -1;
+    flags = PTE_U | (s->writable ? PTE_COW : 0);
+    if(s->writable && sharedvm(p)){
+      cached = mem;
+      mem = kalloc();
+      if(mem)
+        memmove(mem, cached, PGSIZE);
+      kfree(cached);
+      if(mem == 0)
+        return -1;
+      flags = PTE_U | PTE_W;
+    }
+  } else {
+    // The file part ends in this page; the rest is zeros.
+    if((mem = kalloc_zeroed()) == 0)
+      return -1;
+    ilock(p->exe);
+    if(readi(p->exe, mem, off, n) != n){
+      iunlock(p->exe);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(p->exe);
+    flags = PTE_U | (s->writable ? PTE_W : 0);
+  }
+
+  acquire(&faultlock);
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & (PTE_P|PTE_SWAP))){
+    // Another thread paged it in first.
+    kfree(mem);
+  } else if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), flags) < 0){
+    release(&faultlock);
+    kfree(mem);
+    return -1;
+  }
+  release(&faultlock);
+  if(write)
+    return uvmfault(p->pgdir, p->sz, va, 1);
+  return 0;
+}
+
+// Fault in n bytes at va of p's memory, and keep kswapd from
+// paging them out until the current system call returns (see
+// syscall), so that the kernel can use them with spinlocks
+// held or through their kernel address.
+// Returns 0, or -1 if they cannot be faulted in.
+int
+uvmpin(struct proc *p, uint va, uint n, int write)
+{
+  uint a;
+
+  // Pin first: kswapd must not take a page between its
+  // fault and the pin.
+  if(p->pinlo == p->pinhi){
+    p->pinlo = va;
+    p->pinhi = va + n;
+  } else {
+    if(va < p->pinlo)
+      p->pinlo = va;
+    if(va + n > p->pinhi)
+      p->pinhi = va + n;
+  }
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+    if(pagefault(p, a, write) < 0)
+      return -1;
+  return 0;
+}
+
+// Give pgdir its own copy of every copy-on-write page
+// below sz.  Threads sharing pgdir must not share pages
+// copy-on-write: without TLB shootdowns, a thread on
+// another CPU could go on reading the old copy after one
+// thread had written the new one.
+int
+uncow(pde_t *pgdir, uint sz)
+{
+  pte_t *pte;
+  uint va;
+
+  for(va = 0; va < sz; va += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)va, 0);
+    if(pte && (*pte & PTE_COW) && uvmfault(pgdir, 0, va, 1) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+//PAGEBREAK!
+// kswapd's clock: the next page it looks at is hand.va of the
+// process in slot hand.proc of the process table.
+static struct {
+  int proc;
+  uint va;
+} hand;
+
+#define SCANBATCH 64  // pages swapout looks at per faultlock hold
+
+// Page out one user page, for kswapd.  The clock hand sweeps
+// over the pages of processes that are not running, giving
+// pages used since it last passed (PTE_A) a second chance.
+// It takes only pages with no other user: pages shared by
+// fork or the page cache are not worth a write to free.
+// Returns 1 if it paged one out, 0 if the clock went round
+// without finding one, or swap is full.
+int
+swapout(void)
+{
+  pde_t *pgdir;
+  pte_t *pte;
+  uint sz, va, e, n, turns;
+  int slot;
+  char *mem;
+
+  acquire(&faultlock);
+  for(n = turns = 0; ; n++){
+    if(n == SCANBATCH){
+      // Let faults in now and then.
+      release(&faultlock);
+      n = 0;
+      acquire(&faultlock);
+    }
+    pgdir = uservm(hand.proc, &sz);
+    if(pgdir == 0 || hand.va >= sz || vmrunning(pgdir)){
+      hand.va = 0;
+      if(++hand.proc == NPROC){
+        hand.proc = 0;
+        // Two whole turns, after a partial one, clear every
+        // PTE_A that was set.
+        if(++turns == 3){
+          release(&faultlock);
+          return 0;
+        }
+      }
+      continue;
+    }
+    va = hand.va;
+    hand.va += PGSIZE;
+    if((pte = walkpgdir(pgdir, (char*)va, 0)) == 0){
+      hand.va = PGADDR(PDX(va) + 1, 0, 0);
+      continue;
+    }
+    e = *pte;
+    if((e & (PTE_P|PTE_U)) != (PTE_P|PTE_U) ||
+       krefs(P2V(PTE_ADDR(e))) != 1 || vmpinned(pgdir, va))
+      continue;
+    if(e & PTE_A){
+      *pte = e & ~PTE_A;
+      continue;
+    }
+    if((slot = swapalloc()) < 0){
+      release(&faultlock);
+      return 0;
+    }
+    // A copy-on-write page with no other user is private.
+    if(e & PTE_COW)
+      e |= PTE_W;
+    e = xchg(pte, SWAPPTE(slot, e));
+    // A CPU that began running pgdir before the exchange may
+    // hold the old PTE in its TLB.  (xchg is a full barrier.)
+    if(vmrunning(pgdir)){
+      *pte = e;
+      swapfree(slot);
+      continue;
+    }
+    break;
+  }
+  // Faults on the page wait for the write (see swapin).
+  pageout = slot;
+  swapdup(slot);
+  release(&faultlock);
+
+  mem = P2V(PTE_ADDR(e));
+  swapwrite(slot, mem);
+
+  acquire(&faultlock);
+  pageout = -1;
+  wakeup(&pageout);
+  swapfree(slot);
+  release(&faultlock);
+  kfree(mem);
+  return 1;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -352,7 +759,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -372,8 +779,17 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
     pa0 = uva2ka(pgdir, (char*)va0);
-    if(pa0 == 0)
-      return -1;
+    if(pa0 == 0){
+      // Read it back in if paged out.
+      if(uvmfault(pgdir, 0, va0, 0) < 0 ||
+         (pa0 = uva2ka(pgdir, (char*)va0)) == 0)
+        return -1;
+    }
+    if((*walkpgdir(pgdir, (char*)va0, 0) & PTE_COW) != 0){
+      if(uvmfault(pgdir, 0, va0, 1) < 0)
+        return -1;
+      pa0 = uva2ka(pgdir, (char*)va0);
+    }
     n = PGSIZE - (va - va0);
     if(n > len)
       n = len;
@@ -0,0 +1,65 @@
+// wakeupbench: wakeup latency.
+//   wakeupbench [nidle [rounds]]
+// Parks nidle processes asleep on a pipe, then bounces a byte
+// between two processes over a pair of pipes; every hop is a
+// sleep and a wakeup.  Reports the time per round trip, which
+// should not grow with nidle.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int nidle, rounds, i, park[2], ping[2], pong[2];
+  uint t0, t;
+  char c;
+
+  nidle = argc > 1 ? atoi(argv[1]) : 0;
+  rounds = argc > 2 ? atoi(argv[2]) : 10000;
+  if(pipe(park) < 0 || pipe(ping) < 0 || pipe(pong) < 0){
+    printf(2, "wakeupbench: pipe failed\n");
+    exit();
+  }
+
+  // Idle sleepers: block reading park until it is closed.
+  for(i = 0; i < nidle; i++){
+    if(fork() == 0){
+      close(park[1]);
+      read(park[0], &c, 1);
+      exit();
+    }
+  }
+  close(park[0]);
+
+  if(fork() == 0){
+    for(i = 0; i < rounds; i++){
+      if(read(ping[0], &c, 1) != 1)
+        break;
+      write(pong[1], &c, 1);
+    }
+    exit();
+  }
+
+  c = 'x';
+  t0 = usecs();
+  for(i = 0; i < rounds; i++){
+    write(ping[1], &c, 1);
+    if(read(pong[0], &c, 1) != 1){
+      printf(2, "wakeupbench: lost the ball\n");
+      break;
+    }
+  }
+  t = usecs() - t0;
+
+  close(park[1]);
+  for(i = 0; i < nidle + 1; i++)
+    wait();
+
+  printf(1, "wakeupbench: %d idle, %d round trips in %d ms", nidle, rounds, t/1000);
+  if(rounds > 0)
+    printf(1, " (%d us each)", t/rounds);
+  printf(1, "\n");
+  exit();
+}